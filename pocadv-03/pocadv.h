@@ -53,7 +53,9 @@ float pocadv_get_delta_time();
 // Returns sound ID or -1 on failure
 int pocadv_load_wav(const char *file);
 
-// Control playback of sounds by sound ID
+// Control playback of sounds by sound ID. Requests are queued to the audio
+// thread and take effect at the start of its next buffer; call these from
+// one thread only.
 void pocadv_play_sound(int sound_id);
 void pocadv_pause_sound(int sound_id);
 void pocadv_unpause_sound(int sound_id);
@@ -94,6 +96,27 @@ static int pocadv_sound_capacity = 0;
 static SDL_AudioSpec pocadv_device_spec;
 static SDL_AudioDeviceID pocadv_audio_device = 0;
 
+// Playback requests, passed from the game thread to the audio thread through
+// a single-producer/single-consumer ring. Only the audio thread touches the
+// playback state of a PocadvSound.
+typedef enum {
+    POCADV_AUDIO_PLAY,
+    POCADV_AUDIO_PAUSE,
+    POCADV_AUDIO_UNPAUSE,
+    POCADV_AUDIO_STOP
+} PocadvAudioOp;
+
+typedef struct {
+    int op;
+    int sound_id;
+} PocadvAudioCmd;
+
+#define POCADV_AUDIO_QUEUE_SIZE 256 // must be a power of two
+
+static PocadvAudioCmd pocadv_audio_queue[POCADV_AUDIO_QUEUE_SIZE];
+static SDL_atomic_t pocadv_audio_queue_head; // next slot to write, game thread
+static SDL_atomic_t pocadv_audio_queue_tail; // next slot to read, audio thread
+
 // -------- Initialization & Quit --------
 
 int pocadv_init(const char *title, int width, int height) {
@@ -117,18 +140,19 @@ int pocadv_init(const char *title, int width, int height) {
     pocadv_device_spec.format = AUDIO_S16SYS;
     pocadv_device_spec.channels = 2;
     pocadv_device_spec.samples = 4096;
-    pocadv_device_spec.callback = NULL; // set later
+    pocadv_device_spec.callback = pocadv_audio_callback;
+    pocadv_device_spec.userdata = NULL;
+
+    SDL_AtomicSet(&pocadv_audio_queue_head, 0);
+    SDL_AtomicSet(&pocadv_audio_queue_tail, 0);
 
-    // Open audio device with callback
+    // Open audio device with callback. The mixer only handles this exact
+    // format, so let SDL convert if the hardware wants something else.
     pocadv_audio_device = SDL_OpenAudioDevice(NULL, 0,
                                               &pocadv_device_spec,
-                                              &pocadv_device_spec,
-                                              SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+                                              NULL, 0);
     if (pocadv_audio_device == 0) return -1;
 
-    // Set callback after device open
-    pocadv_device_spec.callback = pocadv_audio_callback;
-    pocadv_device_spec.userdata = NULL;
     SDL_PauseAudioDevice(pocadv_audio_device, 0);
 
     return 0;
@@ -148,8 +172,56 @@ void pocadv_quit() {
 
 // -------- Audio Callback (mix multiple sounds) --------
 
+// Applies queued playback requests. Runs on the audio thread, or on the game
+// thread while it holds the device lock.
+static void pocadv_audio_drain() {
+    Uint32 tail = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_tail);
+    Uint32 head = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_head);
+
+    for (; tail != head; tail++) {
+        const PocadvAudioCmd *cmd = &pocadv_audio_queue[tail & (POCADV_AUDIO_QUEUE_SIZE - 1)];
+        if (cmd->sound_id < 0 || cmd->sound_id >= pocadv_sound_count) continue;
+        PocadvSound *s = &pocadv_sounds[cmd->sound_id];
+
+        switch (cmd->op) {
+            case POCADV_AUDIO_PLAY:
+                s->position = 0;
+                s->playing = 1;
+                break;
+            case POCADV_AUDIO_PAUSE:
+                if (s->playing == 1) s->playing = 2;
+                break;
+            case POCADV_AUDIO_UNPAUSE:
+                if (s->playing == 2) s->playing = 1;
+                break;
+            case POCADV_AUDIO_STOP:
+                s->playing = 0;
+                s->position = 0;
+                break;
+        }
+    }
+    SDL_AtomicSet(&pocadv_audio_queue_tail, (int)tail);
+}
+
+// Queues a playback request without blocking. Only when the ring is full
+// does it take the device lock and apply the backlog itself.
+static void pocadv_audio_push(int op, int sound_id) {
+    Uint32 head = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_head);
+    if (head - (Uint32)SDL_AtomicGet(&pocadv_audio_queue_tail) >= POCADV_AUDIO_QUEUE_SIZE) {
+        SDL_LockAudioDevice(pocadv_audio_device);
+        pocadv_audio_drain();
+        SDL_UnlockAudioDevice(pocadv_audio_device);
+    }
+
+    PocadvAudioCmd *cmd = &pocadv_audio_queue[head & (POCADV_AUDIO_QUEUE_SIZE - 1)];
+    cmd->op = op;
+    cmd->sound_id = sound_id;
+    SDL_AtomicSet(&pocadv_audio_queue_head, (int)(head + 1)); // publishes the command
+}
+
 void pocadv_audio_callback(void *userdata, Uint8 *stream, int len) {
     SDL_memset(stream, 0, len);
+    pocadv_audio_drain();
 
     for (int i = 0; i < pocadv_sound_count; i++) {
         PocadvSound *s = &pocadv_sounds[i];
@@ -430,10 +502,14 @@ int pocadv_load_wav(const char *file) {
         spec.channels = pocadv_device_spec.channels;
     }
 
+    // The callback walks the sound table, so it only changes with the device locked
+    SDL_LockAudioDevice(pocadv_audio_device);
+
     if (pocadv_sound_count >= pocadv_sound_capacity) {
         int new_capacity = pocadv_sound_capacity == 0 ? 16 : pocadv_sound_capacity * 2;
         PocadvSound *new_sounds = (PocadvSound*)realloc(pocadv_sounds, new_capacity * sizeof(PocadvSound));
         if (!new_sounds) {
+            SDL_UnlockAudioDevice(pocadv_audio_device);
             SDL_FreeWAV(buffer);
             printf("Failed to realloc for audio buffer\n");
             return -1;
@@ -454,40 +530,34 @@ int pocadv_load_wav(const char *file) {
     pocadv_sounds[pocadv_sound_count].playing = 0;
     pocadv_sounds[pocadv_sound_count].spec = spec;
 
-    return pocadv_sound_count++;
+    int sound_id = pocadv_sound_count++;
+    SDL_UnlockAudioDevice(pocadv_audio_device);
+    return sound_id;
 }
 
 void pocadv_play_sound(int sound_id) {
     if (sound_id < 0 || sound_id >= pocadv_sound_count) return;
-    PocadvSound *s = &pocadv_sounds[sound_id];
-    if (!s->buffer) return;
-
-    s->position = 0;
-    s->playing = 1;
+    if (!pocadv_sounds[sound_id].buffer) return;
+    pocadv_audio_push(POCADV_AUDIO_PLAY, sound_id);
 }
 
 void pocadv_pause_sound(int sound_id) {
     if (sound_id < 0 || sound_id >= pocadv_sound_count) return;
-    PocadvSound *s = &pocadv_sounds[sound_id];
-    if (s->playing == 1)
-        s->playing = 2;
+    pocadv_audio_push(POCADV_AUDIO_PAUSE, sound_id);
 }
 
 void pocadv_unpause_sound(int sound_id) {
     if (sound_id < 0 || sound_id >= pocadv_sound_count) return;
-    PocadvSound *s = &pocadv_sounds[sound_id];
-    if (s->playing == 2)
-        s->playing = 1;
+    pocadv_audio_push(POCADV_AUDIO_UNPAUSE, sound_id);
 }
 
 void pocadv_stop_sound(int sound_id) {
     if (sound_id < 0 || sound_id >= pocadv_sound_count) return;
-    PocadvSound *s = &pocadv_sounds[sound_id];
-    s->playing = 0;
-    s->position = 0;
+    pocadv_audio_push(POCADV_AUDIO_STOP, sound_id);
 }
 
 void pocadv_free_all_audio() {
+    SDL_LockAudioDevice(pocadv_audio_device);
     if (pocadv_sounds) {
         for (int i = 0; i < pocadv_sound_count; i++) {
             if (pocadv_sounds[i].buffer) {
@@ -503,6 +573,11 @@ void pocadv_free_all_audio() {
         pocadv_sound_count = 0;
         pocadv_sound_capacity = 0;
     }
+    // Queued requests name sound IDs that are gone; drop them so they don't
+    // reach sounds loaded later under the same IDs
+    SDL_AtomicSet(&pocadv_audio_queue_head, 0);
+    SDL_AtomicSet(&pocadv_audio_queue_tail, 0);
+    SDL_UnlockAudioDevice(pocadv_audio_device);
 }
 
 #ifdef __cplusplus
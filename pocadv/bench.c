@@ -0,0 +1,208 @@
+#define POCADV_IMPLEMENTATION
+#include "pocadv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mixer benchmark: runs pocadv_audio_callback offline, with the device
+// paused, for every combination of the listed settings and prints one CSV
+// row per combination. Times are per callback; budget_us is how long the
+// device takes to play one buffer, so max_us must stay well below it.
+//
+//   bench [-v voices] [-b buffer_frames] [-c channels] [-r rates]
+//         [-k scalar,sse2,avx2] [-l] [-a] [-e] [-n callbacks] [-s sound]
+//
+// Lists are comma separated. -l gives every voice a gain and pan, so the
+// ramped kernels run instead of the plain add; -a keeps the sound as IMA
+// ADPCM, so it is decoded as it is mixed; -e also sends every voice to an
+// effect bus with a low-pass filter, a delay and a reverb.
+
+#define MAX_LIST 16
+
+typedef struct {
+    int values[MAX_LIST];
+    int count;
+} IntList;
+
+static void parse_ints(IntList *list, const char *arg) {
+    list->count = 0;
+    while (*arg && list->count < MAX_LIST) {
+        list->values[list->count++] = atoi(arg);
+        arg = strchr(arg, ',');
+        if (!arg) break;
+        arg++;
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    Uint64 x = *(const Uint64*)a, y = *(const Uint64*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Points the mixer at one set of kernels; returns -1 if the CPU lacks them
+static int use_kernels(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        pocadv_mix_add = pocadv_mix_add_scalar;
+        pocadv_mix_clip = pocadv_mix_clip_scalar;
+        pocadv_mix_ramp = pocadv_mix_ramp_scalar;
+        pocadv_fx_biquad = pocadv_fx_biquad_scalar;
+        return 0;
+    }
+#ifdef POCADV_X86
+    if (strcmp(name, "sse2") == 0 && SDL_HasSSE2()) {
+        pocadv_mix_add = pocadv_mix_add_sse2;
+        pocadv_mix_clip = pocadv_mix_clip_sse2;
+        pocadv_mix_ramp = pocadv_mix_ramp_sse2;
+        pocadv_fx_biquad = pocadv_fx_biquad_sse2;
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && SDL_HasAVX2()) {
+        pocadv_mix_add = pocadv_mix_add_avx2;
+        pocadv_mix_clip = pocadv_mix_clip_avx2;
+        pocadv_mix_ramp = pocadv_mix_ramp_avx2;
+        pocadv_fx_biquad = pocadv_fx_biquad_sse2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+static int run(const char *kernel, int voices, int frames, int channels, int rate,
+               int levels, int adpcm, int effects, int callbacks, const char *sound) {
+    pocadv_Options opts = {
+        .backend = POCADV_BACKEND_RENDERER,
+        .headless = 1,
+        .voice_steal = POCADV_STEAL_OLDEST,
+        .audio_freq = rate,
+        .audio_channels = channels,
+        .audio_samples = frames,
+        .audio_adpcm = adpcm,
+        .audio_buses = effects,
+    };
+    if (pocadv_init_opts("bench", 16, 16, &opts) != 0 || pocadv_audio_device == 0) {
+        fprintf(stderr, "no audio device: %s\n", SDL_GetError());
+        pocadv_quit();
+        return -1;
+    }
+    // The mixer only runs when called below
+    SDL_PauseAudioDevice(pocadv_audio_device, 1);
+
+    // The device may round the buffer size and clamp the channel count;
+    // the rows report what it actually uses
+    frames = pocadv_device_spec.samples;
+    channels = pocadv_device_spec.channels;
+
+    if (use_kernels(kernel) < 0) {
+        pocadv_quit();
+        return 0; // not supported here; no row
+    }
+    if (effects) {
+        pocadv_bus_set_filter(0, POCADV_FILTER_LOWPASS, 800.0f, 0.707f);
+        pocadv_bus_set_delay(0, 0.25f, 0.4f);
+        pocadv_bus_set_reverb(0, 1.5f, 0.3f);
+    }
+
+    pocadv_Audio **handles = (pocadv_Audio**)calloc((size_t)voices, sizeof(pocadv_Audio*));
+    for (int i = 0; i < voices; i++) {
+        handles[i] = pocadv_audio_load(sound);
+        if (!handles[i]) {
+            fprintf(stderr, "failed to load %s\n", sound);
+            pocadv_quit();
+            return -1;
+        }
+        if (levels) {
+            pocadv_audio_set_gain(handles[i], 0.5f);
+            pocadv_audio_set_pan(handles[i], (float)(i % 9) / 4.0f - 1.0f);
+        }
+        if (effects) pocadv_audio_set_send(handles[i], 0, 0.5f);
+        pocadv_audio_play(handles[i], 0);
+    }
+
+    int len = frames * channels * (int)sizeof(Sint16);
+    Uint8 *out = (Uint8*)malloc((size_t)len);
+    Uint64 *times = (Uint64*)malloc((size_t)callbacks * sizeof(Uint64));
+
+    // Warm up: applies the queued plays and lets level glides finish
+    for (int i = 0; i < 64; i++) pocadv_audio_callback(NULL, out, len);
+
+    Uint64 freq = SDL_GetPerformanceFrequency(), total = 0;
+    for (int i = 0; i < callbacks; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        pocadv_audio_callback(NULL, out, len);
+        times[i] = SDL_GetPerformanceCounter() - start;
+        total += times[i];
+    }
+    qsort(times, (size_t)callbacks, sizeof(Uint64), compare_u64);
+
+    double us = 1e6 / (double)freq;
+    double ns_per_sample = (double)total * 1e9 / (double)freq / ((double)callbacks * frames * channels);
+    printf("%s,%d,%d,%d,%d,%d,%d,%d,%d,%.3f,%.2f,%.2f,%.2f,%.2f\n",
+           kernel, voices, frames, channels, rate, levels, adpcm, effects, callbacks, ns_per_sample,
+           (double)total * us / callbacks, (double)times[callbacks * 99 / 100] * us,
+           (double)times[callbacks - 1] * us, frames * 1e6 / rate);
+    fflush(stdout);
+
+    free(times);
+    free(out);
+    for (int i = 0; i < voices; i++) pocadv_audio_free(handles[i]);
+    free(handles);
+    pocadv_quit();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    IntList voices = {{1, 8, 32, 64, 128, 256}, 6};
+    IntList buffers = {{64, 256, 1024}, 3};
+    IntList channels = {{2}, 1};
+    IntList rates = {{44100}, 1};
+    const char *kernels = "scalar,sse2,avx2";
+    const char *sound = "sound1.wav";
+    int levels = 0, adpcm = 0, effects = 0, callbacks = 2000;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "-e") == 0) {
+            if (argv[i][1] == 'l') levels = 1;
+            else if (argv[i][1] == 'a') adpcm = 1;
+            else effects = 1;
+            continue;
+        }
+        if (!arg || argv[i][0] != '-') {
+            fprintf(stderr, "usage: %s [-v voices] [-b buffer_frames] [-c channels] [-r rates] "
+                            "[-k kernels] [-l] [-a] [-e] [-n callbacks] [-s sound]\n", argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 'v': parse_ints(&voices, arg); break;
+            case 'b': parse_ints(&buffers, arg); break;
+            case 'c': parse_ints(&channels, arg); break;
+            case 'r': parse_ints(&rates, arg); break;
+            case 'k': kernels = arg; break;
+            case 'n': callbacks = atoi(arg) > 0 ? atoi(arg) : 1; break;
+            case 's': sound = arg; break;
+        }
+        i++;
+    }
+
+    printf("kernel,voices,buffer_frames,channels,rate,levels,adpcm,effects,callbacks,"
+           "ns_per_sample,mean_us,p99_us,max_us,budget_us\n");
+
+    char kernel[16];
+    for (const char *k = kernels; *k;) {
+        size_t n = strcspn(k, ",");
+        if (n >= sizeof(kernel)) n = sizeof(kernel) - 1;
+        memcpy(kernel, k, n);
+        kernel[n] = '\0';
+        k += k[n] ? n + 1 : n;
+
+        for (int r = 0; r < rates.count; r++)
+            for (int c = 0; c < channels.count; c++)
+                for (int b = 0; b < buffers.count; b++)
+                    for (int v = 0; v < voices.count; v++)
+                        if (run(kernel, voices.values[v], buffers.values[b], channels.values[c],
+                                rates.values[r], levels, adpcm, effects, callbacks, sound) < 0)
+                            return 1;
+    }
+    return 0;
+}
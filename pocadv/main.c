@@ -25,16 +25,19 @@ int main(int argc, char *argv[]) {
     }
 
     // Load textures
-    SDL_Texture *texture = pocadv_load_texture("star.bmp");
+    pocadv_Texture *texture = pocadv_load_texture("star.bmp");
     if (!texture) {
         printf("Failed to load example.bmp\n");
     }
 
-	pocadv_Audio *bgmusic = pocadv_audio_load("bgmusic.wav");
+	pocadv_Music *bgmusic = pocadv_music_open("bgmusic.mp3");
 	pocadv_Audio *sound1 = pocadv_audio_load("sound1.wav");
 	pocadv_Audio *sound2 = pocadv_audio_load("sound2.wav");
 
-	pocadv_audio_play(bgmusic,0);
+	pocadv_music_play(bgmusic,0);
+
+    // The primitives never change, so they are drawn once into a layer
+    pocadv_Layer *shapes = pocadv_layer_create(800, 600);
 
     // Color for primitives
     SDL_Color red = {255, 0, 0, 255};
@@ -86,22 +89,27 @@ int main(int argc, char *argv[]) {
         pocadv_set_color((SDL_Color){0, 0, 0, 255});
         pocadv_clear();
 
-        // Draw some primitives
-        pocadv_set_color(red);
-        pocadv_draw_line(50, 50, 750, 50);
-        pocadv_draw_rect(50, 100, 200, 100);
-
-        pocadv_set_color(green);
-        pocadv_draw_rect_filled(300, 100, 200, 100);
-        pocadv_draw_circle(650, 150, 50);
-        pocadv_draw_circle_filled(650, 300, 50);
-
-        // Draw polygon
-        SDL_Point poly[5] = {{300,400},{350,450},{325,500},{275,500},{250,450}};
-        pocadv_set_color(red);
-        pocadv_draw_poly_filled(poly, 5);
-        pocadv_set_color(white);
-        pocadv_draw_poly(poly, 5);
+        // Draw some primitives, straight to the screen if there's no layer
+        if (!shapes || pocadv_layer_begin(shapes)) {
+            pocadv_set_color(red);
+            pocadv_draw_line(50, 50, 750, 50);
+            pocadv_draw_rect(50, 100, 200, 100);
+
+            pocadv_set_color(green);
+            pocadv_draw_rect_filled(300, 100, 200, 100);
+            pocadv_draw_circle(650, 150, 50);
+            pocadv_draw_circle_filled(650, 300, 50);
+
+            // Draw polygon
+            SDL_Point poly[5] = {{300,400},{350,450},{325,500},{275,500},{250,450}};
+            pocadv_set_color(red);
+            pocadv_draw_poly_filled(poly, 5);
+            pocadv_set_color(white);
+            pocadv_draw_poly(poly, 5);
+
+            if (shapes) pocadv_layer_end(shapes);
+        }
+        pocadv_layer_draw(shapes, 0, 0);
 
         // Draw texture at mouse
         if (texture)
@@ -120,7 +128,9 @@ int main(int argc, char *argv[]) {
         frame++;
     }
 
-    if (texture) SDL_DestroyTexture(texture);
+    pocadv_layer_free(shapes);
+    pocadv_texture_release(texture);
+    pocadv_music_close(bgmusic);
     pocadv_quit();
     return 0;
 }
@@ -5,21 +5,178 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+// POSIX headers only for the implementation, which maps sound files
+#if defined(POCADV_IMPLEMENTATION) && (defined(__unix__) || defined(__APPLE__))
+#define POCADV_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define POCADV_X86
+#include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Backends: the SDL renderer (default), or a software framebuffer where all
+// drawing is rasterized on the CPU into an ARGB8888 buffer that is uploaded
+// once per frame in pocadv_present. Software mode avoids per-call driver
+// overhead and gives pixel-exact, reproducible output. It draws textures
+// colour-keyed (fully transparent pixels are skipped, the rest copied) and
+// samples rotated or scaled sprites nearest-neighbour.
+typedef enum {
+    POCADV_BACKEND_RENDERER,
+    POCADV_BACKEND_SOFTWARE
+} pocadv_Backend;
+
+// What pocadv_play_sound does when every pooled voice is busy
+typedef enum {
+    POCADV_STEAL_OLDEST,     // restart the voice that started longest ago
+    POCADV_STEAL_QUIETEST    // restart the voice whose sound's peak times its gain is lowest
+} pocadv_VoiceSteal;
+
+// Headless mode opens no window: frames are drawn into an offscreen surface
+// and audio goes to SDL's dummy driver, or to the raw PCM file `audio_dump`
+// through the disk driver. Everything else keeps working, so frame time and
+// audio can be measured on machines without a display or sound card.
+// With `audio_cache` set (SDL_GetPrefPath makes a good one), sounds that
+// need decoding or converting to the device format are saved there once
+// converted and loaded as they are on later runs. Entries are keyed by a
+// hash of the source file's contents, so an edited file is converted again.
+// The audio fields left at 0 give 44100 Hz stereo in buffers of 1024 frames
+// (23 ms); small buffers cut latency at the cost of more wakeups and a
+// higher risk of underruns. SDL converts if the hardware differs.
+// `audio_adpcm` keeps sounds as 4-bit IMA ADPCM, a quarter of the memory,
+// and the mixer decodes them as they play. Sounds are encoded when loaded,
+// or used as they are when the file is already IMA ADPCM at the device's
+// rate and channel count. Music isn't affected.
+// `audio_buses` sets how many effect buses (see pocadv_bus_set_filter) to
+// allocate, up to POCADV_MAX_BUSES; each costs about a second of audio for
+// its delay line.
+#define POCADV_MAX_CHANNELS 8
+
+typedef struct {
+    pocadv_Backend backend;
+    int headless;
+    const char *audio_dump;  // headless only; NULL discards the audio
+    pocadv_VoiceSteal voice_steal;
+    const char *audio_cache; // existing directory for converted sounds, or NULL
+    int audio_freq;          // sample rate
+    int audio_channels;      // 1 for mono, 2 for stereo, up to POCADV_MAX_CHANNELS
+    int audio_samples;       // device buffer size in frames, rounded up to a power of two
+    int audio_adpcm;
+    int audio_buses;
+} pocadv_Options;
+
 // Initialization and cleanup
 int pocadv_init(const char *title, int width, int height);
+// opts may be NULL for the defaults pocadv_init uses
+int pocadv_init_opts(const char *title, int width, int height, const pocadv_Options *opts);
 void pocadv_quit();
 
 // Rendering
 void pocadv_clear();
 void pocadv_present();
 
-SDL_Texture* pocadv_load_texture(const char *file);
-void pocadv_draw_texture(SDL_Texture *tex, int x, int y);
-void pocadv_draw_texture_clipped(SDL_Texture *tex, int x, int y, const SDL_Rect *clip);
+// Saves the frame drawn so far as a BMP; call it before pocadv_present
+int pocadv_dump_frame(const char *file);
+
+// Software backend only: the ARGB8888 framebuffer, `width` pixels per row.
+// Returns NULL with the renderer backend.
+Uint32* pocadv_get_framebuffer(int *width, int *height);
+
+// Deferred drawing: when enabled, draw calls are recorded and submitted in
+// pocadv_present (or pocadv_flush), sorted by texture and colour and merged
+// into as few SDL calls as possible. Draw order is only kept between calls
+// that share the same texture and colour; use pocadv_flush to force it.
+// Freeing a texture that recorded draws still use flushes them first.
+// The software backend draws immediately and ignores this setting.
+void pocadv_set_deferred(int enabled);
+void pocadv_flush();
+
+// Texture handle. Size, format and blend mode are read once at load time and
+// the covered area is kept in both pixels and normalised texture coordinates,
+// so drawing never has to query SDL. A handle may cover only part of its SDL
+// texture: atlas regions and clips made with pocadv_texture_clip do.
+typedef struct {
+    SDL_Texture *texture;  // underlying SDL texture (an atlas page for regions)
+    SDL_Rect rect;         // area of `texture` this handle covers
+    int tex_w, tex_h;      // full size of `texture`
+    Uint32 format;
+    SDL_BlendMode blend;
+    SDL_FRect uv;          // `rect` in normalised texture coordinates
+} pocadv_Texture;
+
+// Textures are cached by path: loading a file again returns the same texture
+// with its reference count raised. Release each load with
+// pocadv_texture_release; the texture is destroyed when the last reference
+// goes away.
+pocadv_Texture* pocadv_load_texture(const char *file);
+void pocadv_texture_release(pocadv_Texture *tex);
+void pocadv_texture_cache_stats(int *hits, int *misses);
+
+// Returns a handle for part of a texture (e.g. one frame of a sprite sheet)
+// with its texture coordinates precomputed. It stays valid as long as the
+// texture it was made from.
+pocadv_Texture pocadv_texture_clip(const pocadv_Texture *tex, SDL_Rect clip);
+
+// Clips are relative to the area the handle covers
+void pocadv_draw_texture(const pocadv_Texture *tex, int x, int y);
+void pocadv_draw_texture_clipped(const pocadv_Texture *tex, int x, int y, const SDL_Rect *clip);
+
+// Texture atlas: packs several BMPs (magenta colour key applied) into as few
+// textures as possible. regions[i] holds files[i]. A region is a texture
+// handle onto its page, so its `texture` and `rect` are still there and it
+// is accepted by every texture draw function.
+typedef pocadv_Texture pocadv_Region;
+
+typedef struct {
+    SDL_Texture **pages;
+    int page_count;
+    pocadv_Region *regions;
+    int region_count;
+} pocadv_Atlas;
+
+pocadv_Atlas* pocadv_atlas_build(const char *files[], int n);
+void pocadv_atlas_free(pocadv_Atlas *atlas);
+
+// clip is relative to the region, e.g. one frame of a sprite sheet
+void pocadv_draw_region(const pocadv_Region *region, int x, int y);
+void pocadv_draw_region_clipped(const pocadv_Region *region, int x, int y, const SDL_Rect *clip);
+
+// Sprite batching: sprites queued between pocadv_batch_begin and
+// pocadv_batch_end are drawn with one SDL_RenderGeometry per texture.
+// clip may be NULL for the whole texture; angle is in degrees, clockwise,
+// around the sprite centre.
+void pocadv_batch_begin();
+void pocadv_batch_sprite(const pocadv_Texture *tex, int x, int y, const SDL_Rect *clip,
+                         SDL_Color tint, float angle, SDL_RendererFlip flip);
+void pocadv_batch_end();
+
+// Layers cache drawing that rarely changes. Draws between pocadv_layer_begin
+// and pocadv_layer_end go into the layer instead of the screen, and
+// pocadv_layer_draw puts the result on screen with a single copy.
+// pocadv_layer_begin returns 0 when the layer is still up to date: skip the
+// drawing and the pocadv_layer_end. Layers start out dirty, become dirty
+// again through pocadv_layer_invalidate, and when the renderer loses its
+// target textures. Layers don't nest; don't call pocadv_clear inside one.
+// pocadv_quit releases what layers hold but leaves the handles to the
+// caller: pocadv_layer_free still frees them, before or after quit.
+typedef struct {
+    pocadv_Texture texture;  // transparent where nothing was drawn
+    int dirty;
+} pocadv_Layer;
+
+pocadv_Layer* pocadv_layer_create(int width, int height);
+void pocadv_layer_free(pocadv_Layer *layer);
+int pocadv_layer_begin(pocadv_Layer *layer);
+void pocadv_layer_end(pocadv_Layer *layer);
+void pocadv_layer_invalidate(pocadv_Layer *layer);
+void pocadv_layer_draw(pocadv_Layer *layer, int x, int y);
 
 // Input
 int pocadv_poll_event(SDL_Event *event);
@@ -42,40 +199,202 @@ void pocadv_draw_rect(int x, int y, int w, int h);
 void pocadv_draw_rect_filled(int x, int y, int w, int h);
 void pocadv_draw_circle(int x, int y, int radius);
 void pocadv_draw_circle_filled(int x, int y, int radius);
+void pocadv_draw_ellipse(int x, int y, int rx, int ry);
+void pocadv_draw_ellipse_filled(int x, int y, int rx, int ry);
+// Arcs: angles in degrees, clockwise from the +x axis (screen y points down).
+// The filled variant draws the pie slice between the arc and the centre.
+void pocadv_draw_arc(int x, int y, int radius, float start_deg, float end_deg);
+void pocadv_draw_arc_filled(int x, int y, int radius, float start_deg, float end_deg);
 void pocadv_draw_poly(const SDL_Point *points, int count);
 void pocadv_draw_poly_filled(const SDL_Point *points, int count);
 
 // Timing
 float pocadv_get_delta_time();
 
-// Audio management struct
+// Audio: everything plays through one device, mixed in software in 16-bit
+// at the rate and channel count from pocadv_Options (44.1 kHz stereo by
+// default). Sounds are WAV or MP3 (MPEG-1 Layer III) files, converted to
+// that format once when loaded, and loading the same file again shares the
+// samples.
+
+// Play, pause, unpause and stop requests are queued to the audio thread
+// without locking and take effect at the start of its next buffer, unless a
+// play is scheduled for a given frame; call them from one thread only. So
+// are level changes.
+
+// Levels: gain scales a voice's samples (1 leaves them as they are, 0 is
+// silent) and pan places it from -1 (left) through 0 (centre, both sides at
+// full level) to 1 (right). The mixer applies them as it mixes, so no copy
+// of the samples is made. Changes glide over 10 ms rather than jumping, and
+// a fade glides the gain over `seconds`: evenly, or exponentially (evenly in
+// decibels), which sounds smoother all the way out.
+typedef enum {
+    POCADV_FADE_LINEAR,
+    POCADV_FADE_EXPONENTIAL
+} pocadv_Fade;
+
+// Sound IDs: every pocadv_play_sound starts another instance on one of
+// POCADV_MAX_VOICES voices set aside at init, so nothing is allocated to
+// play. When they are all busy one is stolen, as pocadv_Options.voice_steal
+// says. Pause, unpause and stop act on every instance of the sound.
+// Returns sound ID or -1 on failure
+int pocadv_load_wav(const char *file);
+
+void pocadv_play_sound(int sound_id);
+// Starts an instance on frame `clock` of the mixer's output; see
+// pocadv_audio_get_clock
+void pocadv_play_sound_at(int sound_id, Uint64 clock);
+void pocadv_pause_sound(int sound_id);
+void pocadv_unpause_sound(int sound_id);
+void pocadv_stop_sound(int sound_id);
+
+// Caps how many instances of a sound play at once; past the cap its oldest
+// instance restarts. 0 (the default) leaves only the pool size as a limit.
+void pocadv_set_sound_limit(int sound_id, int max_instances);
+
+// Levels for every instance of a sound; instances started later begin at
+// the level the last change ends at
+void pocadv_set_sound_gain(int sound_id, float gain);
+void pocadv_set_sound_pan(int sound_id, float pan);
+void pocadv_fade_sound(int sound_id, float gain, float seconds, pocadv_Fade curve);
+
+// Frees every sound; IDs and audio handles are invalid afterwards
+void pocadv_free_all_audio();
+
+typedef struct pocadv_Music pocadv_Music;
+
+// A level gliding from one value to another
 typedef struct {
-    SDL_AudioDeviceID device;
-    SDL_AudioSpec spec;
-    Uint8 *buffer;
-    Uint32 length;
+    float from, to;
+    Uint32 pos, length;     // in frames; the glide is over once pos reaches length
+    int curve;              // pocadv_Fade
+} pocadv_Ramp;
+
+#define POCADV_MAX_BUSES 4
+#define POCADV_DRY -1 // as a bus: a voice's direct path to the output
 
-    int loops_remaining; // -1 means infinite looping
+// How far a voice has decoded an IMA ADPCM block, so the next buffer
+// carries on from there instead of decoding the block from its start
+typedef struct {
+    Uint32 block;
+    int frame;              // the group starting here is next; 0 before the block's header
+    Sint32 predictor[POCADV_MAX_CHANNELS], state[POCADV_MAX_CHANNELS];
+} pocadv_ImaState;
+
+// Audio handle: a playback cursor over a shared sound, so any number of
+// handles can play the same file at once. The fields belong to the mixer.
+typedef struct {
+    struct PocadvSound *sound;
+    pocadv_Music *music;    // set instead of sound for a music stream
+    Uint32 position;        // next frame to mix
+    int loops_remaining;    // -1 means infinite looping
+    Uint32 loop_start;      // frame repeats restart from
+    Uint32 loop_end;        // frame repeats wrap at, 0 for the sound's end
+    int playing;            // 0 = stopped, 1 = playing, 2 = paused
+    Uint32 started;         // mixer's count of plays when this one began
+    Uint64 start;           // sample clock the play is scheduled for
+    pocadv_Ramp gain, pan;
+    pocadv_Ramp dry;        // level to the output
+    pocadv_Ramp send[POCADV_MAX_BUSES]; // levels to the effect buses
+    pocadv_ImaState ima;
 } pocadv_Audio;
 
-// Audio functions
 pocadv_Audio* pocadv_audio_load(const char *file);
 
-// Modified: loop_count - 0 means infinite looping
+// loop_count is how many times to play; 0 means infinite looping
 int pocadv_audio_play(pocadv_Audio *audio, int loop_count);
+int pocadv_audio_play_at(pocadv_Audio *audio, int loop_count, Uint64 clock);
 
 void pocadv_audio_stop(pocadv_Audio *audio);
 void pocadv_audio_pause(pocadv_Audio *audio);
 void pocadv_audio_unpause(pocadv_Audio *audio);
 void pocadv_audio_free(pocadv_Audio *audio);
 
-// Call this regularly (e.g. once per frame) to handle looping playback
-void pocadv_audio_update(pocadv_Audio *audio);
+// Levels of this handle; they stay across plays
+void pocadv_audio_set_gain(pocadv_Audio *audio, float gain);
+void pocadv_audio_set_pan(pocadv_Audio *audio, float pan);
+void pocadv_audio_fade(pocadv_Audio *audio, float gain, float seconds, pocadv_Fade curve);
+
+// Loop points, in seconds rounded to the nearest frame; end 0 means the
+// end of the sound. Every play but the last wraps from `end` back to
+// `start` on the exact frame, and the last one runs on to the sound's end.
+// They stay across plays.
+void pocadv_audio_set_loop(pocadv_Audio *audio, double start, double end);
+
+// Music: streamed from a WAV or MP3 file instead of loaded whole. A worker
+// thread per track decodes and converts a chunk at a time into a ring of
+// about 1.5 s that the mixer reads from, so memory use doesn't depend on the
+// track's length. Close every track before pocadv_quit.
+pocadv_Music* pocadv_music_open(const char *file);
+
+// Restarts the track from the beginning; loop_count as in pocadv_audio_play
+int pocadv_music_play(pocadv_Music *music, int loop_count);
+
+// Moves a playing or paused track to `seconds` from its start, to the
+// sample, and keeps it playing or paused. Returns -1 past the end.
+int pocadv_music_seek(pocadv_Music *music, double seconds);
+
+void pocadv_music_stop(pocadv_Music *music);
+void pocadv_music_pause(pocadv_Music *music);
+void pocadv_music_unpause(pocadv_Music *music);
+void pocadv_music_close(pocadv_Music *music);
+
+// Levels of a track, as for audio handles. Fading one track out while
+// another fades in crossfades them.
+void pocadv_music_set_gain(pocadv_Music *music, float gain);
+void pocadv_music_set_pan(pocadv_Music *music, float pan);
+void pocadv_music_fade(pocadv_Music *music, float gain, float seconds, pocadv_Fade curve);
+
+// Effect buses: besides going to the output, a voice can send its signal,
+// after gain and pan, to any of the pocadv_Options.audio_buses buses. Each
+// bus runs it through a filter, a feedback delay and a reverb, in that
+// order and each only once set, and adds the result to the output at the
+// bus's return level (1 to start with). A bus with none of them set just
+// sums what is sent to it. Sends glide like levels; bus settings take the
+// device lock and apply from the next buffer. Nothing is allocated after
+// init. Lowering a voice's POCADV_DRY level to 0 leaves only what the
+// buses make of it, such as a low-passed, underwater version.
+typedef enum {
+    POCADV_FILTER_NONE,
+    POCADV_FILTER_LOWPASS,
+    POCADV_FILTER_HIGHPASS
+} pocadv_Filter;
+
+// cutoff in Hz; q 0.707 is flat, higher values ring at the cutoff
+void pocadv_bus_set_filter(int bus, pocadv_Filter type, float cutoff, float q);
+// Echoes `seconds` apart, up to 1 s, each `feedback` times the last; 0
+// seconds turns it off
+void pocadv_bus_set_delay(int bus, float seconds, float feedback);
+// A small feedback delay network: `decay` is how many seconds the tail
+// takes to fall by 60 dB, 0 turns it off; damping from 0 to 1 dulls it
+void pocadv_bus_set_reverb(int bus, float decay, float damping);
+void pocadv_bus_set_return(int bus, float gain);
+
+// Send levels, per bus or POCADV_DRY (1 to start with; sends start at 0).
+// For a sound they apply to every instance, like pocadv_set_sound_gain.
+void pocadv_audio_set_send(pocadv_Audio *audio, int bus, float level);
+void pocadv_set_sound_send(int sound_id, int bus, float level);
+void pocadv_music_set_send(pocadv_Music *music, int bus, float level);
+
+// Sample clock: how many frames the mixer has produced since the device
+// opened. A play scheduled for a clock value starts exactly on that frame
+// as long as the request is queued before the mixer gets there, which a
+// device buffer (pocadv_Options.audio_samples) ahead of the clock always
+// is; a late one starts at once. The frame being heard is about the clock
+// minus the queued frames from pocadv_audio_get_latency.
+Uint64 pocadv_audio_get_clock();
+
+// Output latency: how long until a sound played now is heard, estimated
+// from the buffer size the device was opened with and from when the mixer
+// last ran. queued_frames receives the frames mixed but not yet heard and
+// may be NULL. Returns seconds, or -1 without a device.
+double pocadv_audio_get_latency(int *queued_frames);
 
 #ifdef POCADV_IMPLEMENTATION
 
 static SDL_Window *pocadv_window = NULL;
 static SDL_Renderer *pocadv_renderer = NULL;
+static SDL_Surface *pocadv_target = NULL; // headless only: what the renderer draws into
 
 static const Uint8 *pocadv_keyboard_state = NULL;
 static Uint32 pocadv_prev_mouse_buttons = 0;
@@ -85,18 +404,385 @@ static int pocadv_mouse_x = 0, pocadv_mouse_y = 0;
 static Uint64 pocadv_last_counter = 0;
 static float pocadv_delta_time = 0.0f;
 
+static SDL_Color pocadv_draw_color = {0, 0, 0, 255};
+
+// Texture cache
+typedef struct {
+    char *path;
+    Uint32 hash;
+    pocadv_Texture *texture;
+    int refs;
+} PocadvTextureEntry;
+
+static PocadvTextureEntry *pocadv_textures = NULL;
+static int pocadv_texture_count = 0;
+static int pocadv_texture_capacity = 0;
+static int pocadv_texture_hits = 0;
+static int pocadv_texture_misses = 0;
+
+// Sprite batch
+typedef struct {
+    SDL_Texture *texture;
+    int index;             // queue order; the sprite's vertices start at index * 4
+} PocadvBatchSprite;
+
+static int pocadv_batching = 0;
+
+static PocadvBatchSprite *pocadv_batch_sprites = NULL;
+static int pocadv_batch_count = 0;
+static int pocadv_batch_capacity = 0;
+
+static SDL_Vertex *pocadv_batch_vertices = NULL;
+static int pocadv_batch_vertex_capacity = 0;
+static int *pocadv_batch_indices = NULL;
+static int pocadv_batch_index_capacity = 0;
+
+// Audio
+typedef struct PocadvSound {
+    char *path;
+    Uint32 hash;
+    Sint16 *samples;        // interleaved, in the device format; read-only when mapped
+    Uint8 *blocks;          // IMA ADPCM blocks instead of samples, also read-only when mapped
+    int block_size, block_frames;
+    Uint32 frames;
+    void *mapping;          // the whole WAV file when samples point into it
+    size_t mapping_size;
+    int refs;
+    int peak;               // loudest sample, for stealing the quietest voice
+    int max_instances;      // 0 for no limit
+    float gain, pan;        // what new instances start at
+    float dry, send[POCADV_MAX_BUSES]; // the same for sends, but owned by the mixer
+} PocadvSound;
+
+static SDL_AudioSpec pocadv_device_spec;
+static SDL_AudioDeviceID pocadv_audio_device = 0;
+
+static PocadvSound **pocadv_sounds = NULL; // indexed by sound ID, NULL once freed
+static int pocadv_sound_count = 0;
+static int pocadv_sound_capacity = 0;
+
+// Playbacks the mixer visits. Only the audio thread changes the list; its
+// capacity is grown ahead of time, with the device locked, to hold every
+// voice that exists so the audio thread never allocates.
+static pocadv_Audio **pocadv_voices = NULL;
+static int pocadv_voice_count = 0;
+static int pocadv_voice_capacity = 0;
+static int pocadv_voice_total = 0;
+
+// Voices for pocadv_play_sound. A pooled voice is free while it is stopped.
+#define POCADV_MAX_VOICES 64
+
+static pocadv_Audio pocadv_voice_pool[POCADV_MAX_VOICES];
+static pocadv_VoiceSteal pocadv_voice_steal = POCADV_STEAL_OLDEST;
+static Uint32 pocadv_voice_clock = 0; // audio thread only
+
+static char *pocadv_audio_cache = NULL; // pocadv_Options.audio_cache
+static int pocadv_audio_adpcm = 0;      // pocadv_Options.audio_adpcm
+
+// Music streams. The worker decodes into the ring and the mixer reads from
+// it; both positions count frames and only ever grow.
+#define POCADV_MUSIC_RING_FRAMES 65536 // must be a power of two
+#define POCADV_MUSIC_CHUNK_BYTES 16384 // file data read per decoding step
+
+struct pocadv_Music {
+    pocadv_Audio voice;          // what the mixer plays; voice.music points back here
+
+    // Decoding state, only touched with `lock` held
+    SDL_mutex *lock;
+    SDL_RWops *file;
+    struct PocadvMp3 *mp3;       // set for an MP3 file, NULL for a WAV
+    Sint64 data_start, data_size; // the WAV data chunk, in bytes
+    Sint64 data_read;
+    int source_frame_size;
+    int source_freq;
+    SDL_AudioStream *stream;     // converts the file's format to the device's
+    Uint8 *chunk;
+    int started;                 // nothing is decoded before the first play
+    int flushed;                 // the converter has been given the last data
+    int pass_empty;              // nothing decoded since the last rewind
+    int loops_remaining;         // restarts left at the end of the file, -1 forever
+
+    Sint16 *ring;
+    SDL_atomic_t write_pos;      // worker
+    SDL_atomic_t read_pos;       // mixer
+    SDL_atomic_t finished;       // the last frame is in the ring
+
+    SDL_Thread *thread;
+    SDL_sem *wake;               // posted by the mixer as it makes room
+    SDL_atomic_t quit;
+};
+
+// Playback requests, passed from the game thread to the audio thread through
+// a single-producer/single-consumer ring
+typedef enum {
+    POCADV_AUDIO_PLAY,
+    POCADV_AUDIO_PAUSE,
+    POCADV_AUDIO_UNPAUSE,
+    POCADV_AUDIO_STOP,
+    POCADV_AUDIO_GAIN,
+    POCADV_AUDIO_PAN,
+    POCADV_AUDIO_LOOP,
+    POCADV_AUDIO_SEND
+} PocadvAudioOp;
+
+// A request names either one voice, or a sound whose pooled instances it
+// applies to; playing a sound takes a pooled voice.
+typedef struct {
+    int op;
+    pocadv_Audio *voice;
+    PocadvSound *sound;
+    int loops_remaining;   // voice POCADV_AUDIO_PLAY only
+    int max_instances;     // sound POCADV_AUDIO_PLAY only
+    float gain, pan;       // the new level, or for sound POCADV_AUDIO_PLAY the start
+    float seconds;         // how long the level glides for
+    int curve;
+    Uint64 clock;          // POCADV_AUDIO_PLAY only: when to start, 0 for now
+    Uint32 loop_start, loop_end; // POCADV_AUDIO_LOOP only
+    int bus;               // POCADV_AUDIO_SEND only; the level is in gain
+} PocadvAudioCmd;
+
+#define POCADV_AUDIO_QUEUE_SIZE 256 // must be a power of two
+
+static PocadvAudioCmd pocadv_audio_queue[POCADV_AUDIO_QUEUE_SIZE];
+static SDL_atomic_t pocadv_audio_queue_head; // next slot to write, game thread
+static SDL_atomic_t pocadv_audio_queue_tail; // next slot to read, audio thread
+
+// Mix kernels: add n samples onto the 32-bit bus, or saturate n bus samples
+// into the output. The widest version the CPU supports is picked at open.
+typedef void (*PocadvMixAddFn)(Sint32 *bus, const Sint16 *src, int n);
+typedef void (*PocadvMixClipFn)(Sint16 *out, const Sint32 *bus, int n);
+
+// Adds `frames` frames scaled by a per-channel gain that starts at gain[c]
+// and grows by step[c] every frame
+typedef void (*PocadvMixRampFn)(Sint32 *bus, const Sint16 *src, int frames, int channels,
+                                const float *gain, const float *step);
+
+// Runs interleaved float frames through one biquad per channel, in place
+typedef void (*PocadvFxBiquadFn)(float *buf, int frames, int channels, const float *coefs,
+                                 float *z1, float *z2);
+
+static PocadvMixAddFn pocadv_mix_add = NULL;
+static PocadvMixClipFn pocadv_mix_clip = NULL;
+static PocadvMixRampFn pocadv_mix_ramp = NULL;
+static PocadvFxBiquadFn pocadv_fx_biquad = NULL;
+
+#define POCADV_MIX_SEGMENT 64     // frames the gain ramps linearly over
+#define POCADV_MIX_GLIDE 0.01f    // seconds a level change takes at least
+#define POCADV_MIX_FLOOR 0.001f   // -60 dB, where exponential fades start and end
+static Sint32 *pocadv_mix_bus = NULL; // voices sum here without clipping
+static int pocadv_mix_bus_frames = 0;
+static Sint16 *pocadv_mix_blocks = NULL; // one decoded IMA ADPCM block
+
+// When the mixer last ran, how much it mixed and the sample clock after
+// it, for the latency estimate and pocadv_audio_get_clock. The callback
+// publishes them under a sequence lock, so the game thread reads them
+// without taking the device lock: the count is odd while they are being
+// written.
+static SDL_atomic_t pocadv_mix_seq;
+static Uint64 pocadv_mix_counter = 0;
+static int pocadv_mix_frames = 0;
+static Uint64 pocadv_mix_clock_end = 0;
+static Uint64 pocadv_mix_clock = 0; // frames mixed since the device opened; audio thread only
+
+// Effect buses. Voices add their sends to `in` like the dry signal to the
+// mix bus; the bus then works on a float copy and adds it to the mix bus.
+// The settings are changed with the device locked.
+#define POCADV_FX_MAX_DELAY 1.0f // seconds
+#define POCADV_FX_LINES 4        // reverb delay lines
+#define POCADV_FX_PASS 128       // most frames the reverb works on at once
+
+typedef struct {
+    Sint32 *in;
+    float *work;
+    int fed;                     // something was sent to `in` this buffer
+
+    int filter;                  // pocadv_Filter
+    float coefs[5];              // b0, b1, b2, a1, a2, normalised
+    float state[2][POCADV_MAX_CHANNELS]; // per channel
+
+    float *delay;                // interleaved ring of delay_frames frames
+    Uint32 delay_frames, delay_capacity, delay_pos;
+    float feedback;
+
+    float *lines[POCADV_FX_LINES];
+    Uint32 line_frames[POCADV_FX_LINES], line_pos[POCADV_FX_LINES];
+    float line_gain[POCADV_FX_LINES]; // 0 while the reverb is off
+    float line_low[POCADV_FX_LINES];  // damping filters' state
+    float damping;
+
+    float ret, ret_target;       // the return glides over a buffer
+} PocadvFxBus;
+
+static PocadvFxBus pocadv_fx[POCADV_MAX_BUSES];
+static int pocadv_fx_count = 0;
+
+// Layers
+static pocadv_Layer **pocadv_layers = NULL;
+static int pocadv_layer_count = 0;
+static int pocadv_layer_capacity = 0;
+static pocadv_Layer *pocadv_active_layer = NULL;
+
+// Software backend: the screen framebuffer while a layer is being drawn
+static Uint32 *pocadv_screen_fb = NULL;
+static int pocadv_screen_fb_w = 0, pocadv_screen_fb_h = 0;
+
+// Deferred drawing
+typedef enum {
+    POCADV_CMD_POINTS,
+    POCADV_CMD_LINES,      // one polyline, consecutive points are joined
+    POCADV_CMD_RECTS,
+    POCADV_CMD_FILL_RECTS,
+    POCADV_CMD_GEOMETRY    // triangles, coloured per vertex; also texture copies
+} PocadvCmdKind;
+
+typedef struct {
+    SDL_Texture *texture;  // NULL for untextured primitives
+    Uint32 color;          // packed RGBA, 0 for geometry
+    int kind;
+    int seq;               // recording order, keeps the sort stable
+    int first;             // first element in the point, rect or vertex pool
+    int count;
+    int index_first;       // geometry only: indices relative to `first`
+    int index_count;
+} PocadvDrawCmd;
+
+static int pocadv_deferred = 0;
+static int pocadv_clear_pending = 0;
+
+static PocadvDrawCmd *pocadv_cmds = NULL;
+static int pocadv_cmd_count = 0;
+static int pocadv_cmd_capacity = 0;
+
+static SDL_Point *pocadv_cmd_points = NULL;
+static int pocadv_cmd_point_count = 0;
+static int pocadv_cmd_point_capacity = 0;
+
+static SDL_Rect *pocadv_cmd_rects = NULL;
+static int pocadv_cmd_rect_count = 0;
+static int pocadv_cmd_rect_capacity = 0;
+
+static SDL_Vertex *pocadv_cmd_vertices = NULL;
+static int pocadv_cmd_vertex_count = 0;
+static int pocadv_cmd_vertex_capacity = 0;
+
+static int *pocadv_cmd_indices = NULL;
+static int pocadv_cmd_index_count = 0;
+static int pocadv_cmd_index_capacity = 0;
+
+// Scratch buffers used to merge runs of commands at flush time
+static SDL_Point *pocadv_merge_points = NULL;
+static int pocadv_merge_point_capacity = 0;
+static SDL_Rect *pocadv_merge_rects = NULL;
+static int pocadv_merge_rect_capacity = 0;
+static SDL_Vertex *pocadv_merge_vertices = NULL;
+static int pocadv_merge_vertex_capacity = 0;
+static int *pocadv_merge_indices = NULL;
+static int pocadv_merge_index_capacity = 0;
+
+// Scratch buffers the circle, ellipse and arc engine builds shapes in
+static SDL_Point *pocadv_shape_points = NULL;
+static int pocadv_shape_point_capacity = 0;
+static SDL_Vertex *pocadv_shape_vertices = NULL;
+static int pocadv_shape_vertex_capacity = 0;
+static int *pocadv_shape_indices = NULL;
+static int pocadv_shape_index_capacity = 0;
+
+// Polygon filler: edge table, active edge list and the spans it produces
+typedef struct {
+    int y_start;  // first scanline the edge covers
+    int y_end;    // last scanline the edge covers
+    Sint64 x;     // 32.32 fixed-point x at the current scanline
+    Sint64 step;  // 32.32 fixed-point x increment per scanline
+} PocadvPolyEdge;
+
+#define POCADV_POLY_ONE ((Sint64)1 << 32)
+
+static PocadvPolyEdge *pocadv_poly_edges = NULL;
+static int pocadv_poly_edge_capacity = 0;
+static PocadvPolyEdge **pocadv_poly_active = NULL;
+static int pocadv_poly_active_capacity = 0;
+static SDL_Rect *pocadv_poly_spans = NULL;
+static int pocadv_poly_span_capacity = 0;
+
+// Software backend
+typedef struct {
+    SDL_Texture *texture;  // the renderer texture this image shadows
+    Uint32 *pixels;        // ARGB8888, colour-keyed pixels have alpha 0
+    int w, h;
+} PocadvSoftImage;
+
+typedef void (*PocadvFillSpanFn)(Uint32 *dst, Uint32 color, int n);
+typedef void (*PocadvKeySpanFn)(Uint32 *dst, const Uint32 *src, int n);
+
+static int pocadv_soft = 0;
+static Uint32 *pocadv_fb = NULL;
+static int pocadv_fb_w = 0, pocadv_fb_h = 0;
+static SDL_Texture *pocadv_fb_texture = NULL;
+
+static PocadvFillSpanFn pocadv_fill_span = NULL;
+static PocadvKeySpanFn pocadv_key_span = NULL;
+
+static PocadvSoftImage *pocadv_soft_images = NULL;
+static int pocadv_soft_image_count = 0;
+static int pocadv_soft_image_capacity = 0;
+
+static void pocadv_free_draw_commands();
+static void pocadv_free_textures();
+static void pocadv_free_batch();
+static void pocadv_free_layers();
+static void pocadv_audio_open(const pocadv_Options *opts);
+static void pocadv_audio_close();
+
+static int pocadv_soft_init(int width, int height);
+static void pocadv_soft_quit();
+static void pocadv_soft_points(const SDL_Point *points, int count);
+static void pocadv_soft_lines(const SDL_Point *points, int count);
+static void pocadv_soft_rects(const SDL_Rect *rects, int count, int filled);
+static void pocadv_soft_copy(SDL_Texture *tex, const SDL_Rect *src, const SDL_Rect *dst);
+static void pocadv_soft_geometry(SDL_Texture *tex, const SDL_Vertex *vertices,
+                                 const int *indices, int num_indices);
+
 // ----------------------- Initialization ----------------------
 
 int pocadv_init(const char *title, int width, int height) {
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) return -1;
+    return pocadv_init_opts(title, width, height, NULL);
+}
+
+int pocadv_init_opts(const char *title, int width, int height, const pocadv_Options *opts) {
+    pocadv_Options defaults = {POCADV_BACKEND_RENDERER, 0, NULL, POCADV_STEAL_OLDEST, NULL, 0, 0, 0, 0, 0};
+    if (!opts) opts = &defaults;
+
+    pocadv_voice_steal = opts->voice_steal;
+    pocadv_audio_adpcm = opts->audio_adpcm;
+    if (opts->audio_cache && (pocadv_audio_cache = (char*)malloc(strlen(opts->audio_cache) + 1)))
+        strcpy(pocadv_audio_cache, opts->audio_cache);
+
+    if (SDL_Init(opts->headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) != 0) return -1;
+
+    // Audio is optional: without a device sounds fail to load, nothing else
+    if (opts->headless) {
+        if (opts->audio_dump) SDL_setenv("SDL_DISKAUDIOFILE", opts->audio_dump, 1);
+        SDL_setenv("SDL_AUDIODRIVER", opts->audio_dump ? "disk" : "dummy", 1);
+    }
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0) pocadv_audio_open(opts);
 
-    pocadv_window = SDL_CreateWindow(title,
-                                    SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                    width, height, 0);
-    if (!pocadv_window) return -1;
+    int software = opts->backend == POCADV_BACKEND_SOFTWARE;
+    if (opts->headless) {
+        pocadv_target = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (!pocadv_target) return -1;
+        pocadv_renderer = SDL_CreateSoftwareRenderer(pocadv_target);
+    } else {
+        pocadv_window = SDL_CreateWindow(title,
+                                        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                        width, height, 0);
+        if (!pocadv_window) return -1;
 
-    pocadv_renderer = SDL_CreateRenderer(pocadv_window, -1, SDL_RENDERER_ACCELERATED);
+        // The software backend only copies one texture per frame, so it takes
+        // whatever renderer is available rather than insisting on acceleration
+        pocadv_renderer = SDL_CreateRenderer(pocadv_window, -1, software ? 0 : SDL_RENDERER_ACCELERATED);
+    }
     if (!pocadv_renderer) return -1;
+    if (software && pocadv_soft_init(width, height) < 0) return -1;
 
     pocadv_keyboard_state = SDL_GetKeyboardState(NULL);
     pocadv_curr_mouse_buttons = SDL_GetMouseState(&pocadv_mouse_x, &pocadv_mouse_y);
@@ -108,318 +794,5032 @@ int pocadv_init(const char *title, int width, int height) {
 }
 
 void pocadv_quit() {
+    pocadv_free_draw_commands();
+    pocadv_free_batch();
+    pocadv_free_textures();
+    pocadv_free_layers();
+    pocadv_soft_quit();
+
     // Stop audio and close audio device if open
+    pocadv_audio_close();
+    free(pocadv_audio_cache);
+    pocadv_audio_cache = NULL;
+
     if (pocadv_renderer) SDL_DestroyRenderer(pocadv_renderer);
     if (pocadv_window) SDL_DestroyWindow(pocadv_window);
+    if (pocadv_target) SDL_FreeSurface(pocadv_target);
+    pocadv_renderer = NULL;
+    pocadv_window = NULL;
+    pocadv_target = NULL;
 
     SDL_Quit();
 }
 
-// ----------------------- Rendering ----------------------
+// ----------------------- Deferred drawing ----------------------
 
-void pocadv_clear() {
-    SDL_SetRenderDrawColor(pocadv_renderer, 0, 0, 0, 255);
-    SDL_RenderClear(pocadv_renderer);
-}
+// Grows a buffer to hold at least `needed` items, doubling its capacity
+static int pocadv_reserve(void **items, int *capacity, int needed, size_t item_size) {
+    if (needed <= *capacity) return 0;
 
-void pocadv_present() {
-    SDL_RenderPresent(pocadv_renderer);
-}
+    int new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+    while (new_capacity < needed) new_capacity *= 2;
 
-SDL_Texture* pocadv_load_texture(const char *file) {
-    SDL_Surface *surf = SDL_LoadBMP(file);
-    if (!surf) return NULL;
-    SDL_SetColorKey(surf, SDL_TRUE, SDL_MapRGB(surf->format, 0xFF, 0x00, 0xFF));
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(pocadv_renderer, surf);
-    SDL_FreeSurface(surf);
-    return tex;
-}
+    void *new_items = realloc(*items, new_capacity * item_size);
+    if (!new_items) return -1;
 
-void pocadv_draw_texture(SDL_Texture *tex, int x, int y) {
-    SDL_Rect dst = {x, y, 0, 0};
-    SDL_QueryTexture(tex, NULL, NULL, &dst.w, &dst.h);
-    SDL_RenderCopy(pocadv_renderer, tex, NULL, &dst);
+    *items = new_items;
+    *capacity = new_capacity;
+    return 0;
 }
 
-void pocadv_draw_texture_clipped(SDL_Texture *tex, int x, int y, const SDL_Rect *clip) {
-    if (!tex || !clip) return;
-    SDL_Rect dst = {x, y, clip->w, clip->h};
-    SDL_RenderCopy(pocadv_renderer, tex, clip, &dst);
+static Uint32 pocadv_pack_color(SDL_Color color) {
+    return ((Uint32)color.r << 24) | ((Uint32)color.g << 16) | ((Uint32)color.b << 8) | color.a;
 }
 
-// ----------------------- Input ----------------------
+// Appends a command; returns NULL if recording is off or out of memory,
+// in which case the caller draws immediately.
+static PocadvDrawCmd* pocadv_record(int kind, SDL_Texture *tex, int first, int count) {
+    if (!pocadv_deferred) return NULL;
+    if (pocadv_reserve((void**)&pocadv_cmds, &pocadv_cmd_capacity,
+                       pocadv_cmd_count + 1, sizeof(PocadvDrawCmd)) < 0) return NULL;
 
-int pocadv_poll_event(SDL_Event *event) {
-    return SDL_PollEvent(event);
+    PocadvDrawCmd *cmd = &pocadv_cmds[pocadv_cmd_count];
+    cmd->texture = tex;
+    cmd->color = kind == POCADV_CMD_GEOMETRY ? 0 : pocadv_pack_color(pocadv_draw_color);
+    cmd->kind = kind;
+    cmd->seq = pocadv_cmd_count;
+    cmd->first = first;
+    cmd->count = count;
+    cmd->index_first = 0;
+    cmd->index_count = 0;
+    pocadv_cmd_count++;
+    return cmd;
 }
 
-void pocadv_update_input() {
-    pocadv_prev_mouse_buttons = pocadv_curr_mouse_buttons;
-    pocadv_curr_mouse_buttons = SDL_GetMouseState(&pocadv_mouse_x, &pocadv_mouse_y);
-}
+static int pocadv_record_points(int kind, const SDL_Point *points, int count) {
+    if (!pocadv_deferred) return 0;
+    if (pocadv_reserve((void**)&pocadv_cmd_points, &pocadv_cmd_point_capacity,
+                       pocadv_cmd_point_count + count, sizeof(SDL_Point)) < 0) return 0;
+    if (!pocadv_record(kind, NULL, pocadv_cmd_point_count, count)) return 0;
 
-int pocadv_key_down(SDL_Scancode key) {
-    if (pocadv_keyboard_state == NULL) return 0;
-    return pocadv_keyboard_state[key];
+    memcpy(pocadv_cmd_points + pocadv_cmd_point_count, points, count * sizeof(SDL_Point));
+    pocadv_cmd_point_count += count;
+    return 1;
 }
 
-int pocadv_key_up(SDL_Scancode key) {
-    if (pocadv_keyboard_state == NULL) return 1;
-    return !pocadv_keyboard_state[key];
-}
+static int pocadv_record_rects(int kind, const SDL_Rect *rects, int count) {
+    if (!pocadv_deferred) return 0;
+    if (pocadv_reserve((void**)&pocadv_cmd_rects, &pocadv_cmd_rect_capacity,
+                       pocadv_cmd_rect_count + count, sizeof(SDL_Rect)) < 0) return 0;
+    if (!pocadv_record(kind, NULL, pocadv_cmd_rect_count, count)) return 0;
 
-int pocadv_mouse_button_down(Uint8 button) {
-    return (pocadv_curr_mouse_buttons & SDL_BUTTON(button)) != 0;
+    memcpy(pocadv_cmd_rects + pocadv_cmd_rect_count, rects, count * sizeof(SDL_Rect));
+    pocadv_cmd_rect_count += count;
+    return 1;
 }
 
-int pocadv_mouse_button_up(Uint8 button) {
-    return (pocadv_curr_mouse_buttons & SDL_BUTTON(button)) == 0;
-}
+static int pocadv_record_geometry(SDL_Texture *tex, const SDL_Vertex *vertices, int num_vertices,
+                                  const int *indices, int num_indices) {
+    if (!pocadv_deferred) return 0;
+    if (pocadv_reserve((void**)&pocadv_cmd_vertices, &pocadv_cmd_vertex_capacity,
+                       pocadv_cmd_vertex_count + num_vertices, sizeof(SDL_Vertex)) < 0) return 0;
+    if (pocadv_reserve((void**)&pocadv_cmd_indices, &pocadv_cmd_index_capacity,
+                       pocadv_cmd_index_count + num_indices, sizeof(int)) < 0) return 0;
 
-void pocadv_get_mouse_pos(int *x, int *y) {
-    if (x) *x = pocadv_mouse_x;
-    if (y) *y = pocadv_mouse_y;
+    PocadvDrawCmd *cmd = pocadv_record(POCADV_CMD_GEOMETRY, tex, pocadv_cmd_vertex_count, num_vertices);
+    if (!cmd) return 0;
+    cmd->index_first = pocadv_cmd_index_count;
+    cmd->index_count = num_indices;
+
+    memcpy(pocadv_cmd_vertices + pocadv_cmd_vertex_count, vertices, num_vertices * sizeof(SDL_Vertex));
+    memcpy(pocadv_cmd_indices + pocadv_cmd_index_count, indices, num_indices * sizeof(int));
+    pocadv_cmd_vertex_count += num_vertices;
+    pocadv_cmd_index_count += num_indices;
+    return 1;
 }
 
-// ----------------------- Color ----------------------
+// All drawing goes through these, so deferred mode sees every primitive
+static void pocadv_submit_points(const SDL_Point *points, int count) {
+    if (count <= 0) return;
+    if (pocadv_record_points(POCADV_CMD_POINTS, points, count)) return;
+    if (pocadv_soft)
+        pocadv_soft_points(points, count);
+    else
+        SDL_RenderDrawPoints(pocadv_renderer, points, count);
+}
 
-void pocadv_set_color(SDL_Color color) {
-    SDL_SetRenderDrawColor(pocadv_renderer, color.r, color.g, color.b, color.a);
+static void pocadv_submit_lines(const SDL_Point *points, int count) {
+    if (count < 2) return;
+    if (pocadv_record_points(POCADV_CMD_LINES, points, count)) return;
+    if (pocadv_soft)
+        pocadv_soft_lines(points, count);
+    else
+        SDL_RenderDrawLines(pocadv_renderer, points, count);
 }
 
-// --------------------- Primitives ----------------------
+static void pocadv_submit_rects(const SDL_Rect *rects, int count, int filled) {
+    if (count <= 0) return;
+    if (pocadv_record_rects(filled ? POCADV_CMD_FILL_RECTS : POCADV_CMD_RECTS, rects, count)) return;
+    if (pocadv_soft)
+        pocadv_soft_rects(rects, count, filled);
+    else if (filled)
+        SDL_RenderFillRects(pocadv_renderer, rects, count);
+    else
+        SDL_RenderDrawRects(pocadv_renderer, rects, count);
+}
 
-void pocadv_draw_point(int x, int y) {
-    SDL_RenderDrawPoint(pocadv_renderer, x, y);
+// src is in pixels on tex->texture. Deferred copies are recorded as a textured
+// quad, so they merge with sprite batches on the same texture. Passing
+// &tex->rect (the whole handle) uses the cached `uv`.
+static void pocadv_submit_copy(const pocadv_Texture *tex, const SDL_Rect *src, const SDL_Rect *dst) {
+    if (pocadv_deferred) {
+        static const int quad[6] = {0, 1, 2, 0, 2, 3};
+        SDL_Color white = {255, 255, 255, 255};
+        float u0, u1, v0, v1;
+        if (src == &tex->rect) {
+            u0 = tex->uv.x;
+            v0 = tex->uv.y;
+            u1 = u0 + tex->uv.w;
+            v1 = v0 + tex->uv.h;
+        } else {
+            u0 = (float)src->x / tex->tex_w;
+            v0 = (float)src->y / tex->tex_h;
+            u1 = (float)(src->x + src->w) / tex->tex_w;
+            v1 = (float)(src->y + src->h) / tex->tex_h;
+        }
+        float x0 = (float)dst->x, x1 = (float)(dst->x + dst->w);
+        float y0 = (float)dst->y, y1 = (float)(dst->y + dst->h);
+        SDL_Vertex v[4] = {
+            {{x0, y0}, white, {u0, v0}},
+            {{x1, y0}, white, {u1, v0}},
+            {{x1, y1}, white, {u1, v1}},
+            {{x0, y1}, white, {u0, v1}},
+        };
+        if (pocadv_record_geometry(tex->texture, v, 4, quad, 6)) return;
+    }
+    if (pocadv_soft)
+        pocadv_soft_copy(tex->texture, src, dst);
+    else
+        SDL_RenderCopy(pocadv_renderer, tex->texture, src, dst);
 }
 
-void pocadv_draw_line(int x1, int y1, int x2, int y2) {
-    SDL_RenderDrawLine(pocadv_renderer, x1, y1, x2, y2);
+static void pocadv_submit_geometry(SDL_Texture *tex, const SDL_Vertex *vertices, int num_vertices,
+                                   const int *indices, int num_indices) {
+    if (num_vertices <= 0 || num_indices <= 0) return;
+    if (pocadv_record_geometry(tex, vertices, num_vertices, indices, num_indices)) return;
+    if (pocadv_soft)
+        pocadv_soft_geometry(tex, vertices, indices, num_indices);
+    else
+        SDL_RenderGeometry(pocadv_renderer, tex, vertices, num_vertices, indices, num_indices);
 }
 
-void pocadv_draw_rect(int x, int y, int w, int h) {
-    SDL_Rect r = {x, y, w, h};
-    SDL_RenderDrawRect(pocadv_renderer, &r);
+static int pocadv_cmd_compare(const void *a, const void *b) {
+    const PocadvDrawCmd *ca = (const PocadvDrawCmd*)a;
+    const PocadvDrawCmd *cb = (const PocadvDrawCmd*)b;
+
+    if (ca->texture != cb->texture)
+        return (uintptr_t)ca->texture < (uintptr_t)cb->texture ? -1 : 1;
+    if (ca->color != cb->color)
+        return ca->color < cb->color ? -1 : 1;
+    if (ca->kind != cb->kind)
+        return ca->kind - cb->kind;
+    return ca->seq - cb->seq;
 }
 
-void pocadv_draw_rect_filled(int x, int y, int w, int h) {
-    SDL_Rect r = {x, y, w, h};
-    SDL_RenderFillRect(pocadv_renderer, &r);
+static int pocadv_same_state(const PocadvDrawCmd *a, const PocadvDrawCmd *b) {
+    return a->texture == b->texture && a->color == b->color && a->kind == b->kind;
 }
 
-void pocadv_draw_circle(int cx, int cy, int radius) {
-    int x = radius;
-    int y = 0;
-    int err = 0;
-
-    while (x >= y) {
-        SDL_RenderDrawPoint(pocadv_renderer, cx + x, cy + y);
-        SDL_RenderDrawPoint(pocadv_renderer, cx + y, cy + x);
-        SDL_RenderDrawPoint(pocadv_renderer, cx - y, cy + x);
-        SDL_RenderDrawPoint(pocadv_renderer, cx - x, cy + y);
-        SDL_RenderDrawPoint(pocadv_renderer, cx - x, cy - y);
-        SDL_RenderDrawPoint(pocadv_renderer, cx - y, cy - x);
-        SDL_RenderDrawPoint(pocadv_renderer, cx + y, cy - x);
-        SDL_RenderDrawPoint(pocadv_renderer, cx + x, cy - y);
-
-        y += 1;
-        if (err <= 0) {
-            err += 2*y + 1;
-        } else {
-            x -= 1;
-            err += 2*(y - x) + 1;
-        }
+// Draws all points of a run with one SDL_RenderDrawPoints call
+static void pocadv_flush_points(const PocadvDrawCmd *run, int n) {
+    int total = 0;
+    for (int i = 0; i < n; i++) total += run[i].count;
+    if (pocadv_reserve((void**)&pocadv_merge_points, &pocadv_merge_point_capacity,
+                       total, sizeof(SDL_Point)) < 0) return;
+
+    int at = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(pocadv_merge_points + at, pocadv_cmd_points + run[i].first, run[i].count * sizeof(SDL_Point));
+        at += run[i].count;
     }
+    SDL_RenderDrawPoints(pocadv_renderer, pocadv_merge_points, total);
 }
 
-void pocadv_draw_circle_filled(int cx, int cy, int radius) {
-    int x = radius;
-    int y = 0;
-    int err = 0;
+// Joins polylines that continue where the previous one ended, so a polygon
+// outline drawn edge by edge becomes a single SDL_RenderDrawLines call
+static void pocadv_flush_lines(const PocadvDrawCmd *run, int n) {
+    int total = 0;
+    for (int i = 0; i < n; i++) total += run[i].count;
+    if (pocadv_reserve((void**)&pocadv_merge_points, &pocadv_merge_point_capacity,
+                       total, sizeof(SDL_Point)) < 0) return;
 
-    while (x >= y) {
-        SDL_RenderDrawLine(pocadv_renderer, cx - x, cy + y, cx + x, cy + y);
-        SDL_RenderDrawLine(pocadv_renderer, cx - y, cy + x, cx + y, cy + x);
-        SDL_RenderDrawLine(pocadv_renderer, cx - x, cy - y, cx + x, cy - y);
-        SDL_RenderDrawLine(pocadv_renderer, cx - y, cy - x, cx + y, cy - x);
+    int chain = 0;
+    for (int i = 0; i < n; i++) {
+        const SDL_Point *p = pocadv_cmd_points + run[i].first;
+        int count = run[i].count;
 
-        y++;
-        if (err <= 0) {
-            err += 2*y + 1;
-        } else {
-            x--;
-            err += 2*(y - x) + 1;
+        if (chain > 0 &&
+            pocadv_merge_points[chain - 1].x == p[0].x &&
+            pocadv_merge_points[chain - 1].y == p[0].y) {
+            p++;
+            count--;
+        } else if (chain > 0) {
+            SDL_RenderDrawLines(pocadv_renderer, pocadv_merge_points, chain);
+            chain = 0;
         }
+        memcpy(pocadv_merge_points + chain, p, count * sizeof(SDL_Point));
+        chain += count;
     }
+    if (chain > 1) SDL_RenderDrawLines(pocadv_renderer, pocadv_merge_points, chain);
 }
 
-void pocadv_draw_poly(const SDL_Point *points, int count) {
-    if (count < 2) return;
-    for (int i = 0; i < count - 1; i++) {
-        SDL_RenderDrawLine(pocadv_renderer,
-                           points[i].x, points[i].y,
-                           points[i + 1].x, points[i + 1].y);
+static void pocadv_flush_rects(const PocadvDrawCmd *run, int n, int filled) {
+    int total = 0;
+    for (int i = 0; i < n; i++) total += run[i].count;
+    if (pocadv_reserve((void**)&pocadv_merge_rects, &pocadv_merge_rect_capacity,
+                       total, sizeof(SDL_Rect)) < 0) return;
+
+    int at = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(pocadv_merge_rects + at, pocadv_cmd_rects + run[i].first, run[i].count * sizeof(SDL_Rect));
+        at += run[i].count;
     }
-    SDL_RenderDrawLine(pocadv_renderer,
-                       points[count - 1].x, points[count - 1].y,
-                       points[0].x, points[0].y);
+    if (filled)
+        SDL_RenderFillRects(pocadv_renderer, pocadv_merge_rects, total);
+    else
+        SDL_RenderDrawRects(pocadv_renderer, pocadv_merge_rects, total);
 }
 
-void pocadv_draw_poly_filled(const SDL_Point *points, int count) {
-    if (count < 3) return;
+// Concatenates a run of triangle lists into one SDL_RenderGeometry call
+static void pocadv_flush_geometry(const PocadvDrawCmd *run, int n) {
+    int total_vertices = 0, total_indices = 0;
+    for (int i = 0; i < n; i++) {
+        total_vertices += run[i].count;
+        total_indices += run[i].index_count;
+    }
+    if (pocadv_reserve((void**)&pocadv_merge_vertices, &pocadv_merge_vertex_capacity,
+                       total_vertices, sizeof(SDL_Vertex)) < 0) return;
+    if (pocadv_reserve((void**)&pocadv_merge_indices, &pocadv_merge_index_capacity,
+                       total_indices, sizeof(int)) < 0) return;
 
-    int min_y = points[0].y, max_y = points[0].y;
-    for (int i = 1; i < count; i++) {
-        if (points[i].y < min_y) min_y = points[i].y;
-        if (points[i].y > max_y) max_y = points[i].y;
+    int nv = 0, ni = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(pocadv_merge_vertices + nv, pocadv_cmd_vertices + run[i].first, run[i].count * sizeof(SDL_Vertex));
+        const int *idx = pocadv_cmd_indices + run[i].index_first;
+        for (int k = 0; k < run[i].index_count; k++) pocadv_merge_indices[ni++] = idx[k] + nv;
+        nv += run[i].count;
     }
+    SDL_RenderGeometry(pocadv_renderer, run[0].texture, pocadv_merge_vertices, nv, pocadv_merge_indices, ni);
+}
 
-    for (int y = min_y; y <= max_y; y++) {
-        int intersections[64];
-        int n_intersections = 0;
+void pocadv_flush() {
+    if (pocadv_clear_pending) {
+        SDL_SetRenderDrawColor(pocadv_renderer, 0, 0, 0, 255);
+        SDL_RenderClear(pocadv_renderer);
+        pocadv_clear_pending = 0;
+    }
+    if (pocadv_cmd_count == 0) return;
 
-        for (int i = 0; i < count; i++) {
-            int j = (i + 1) % count;
-            int y0 = points[i].y;
-            int y1 = points[j].y;
-            int x0 = points[i].x;
-            int x1 = points[j].x;
+    qsort(pocadv_cmds, pocadv_cmd_count, sizeof(PocadvDrawCmd), pocadv_cmd_compare);
 
-            if ((y0 < y && y1 >= y) || (y1 < y && y0 >= y)) {
-                int x = x0 + (y - y0) * (x1 - x0) / (y1 - y0);
-                if (n_intersections < 64) {
-                    intersections[n_intersections++] = x;
-                }
-            }
-        }
+    int have_color = 0;
+    Uint32 color = 0;
+    int i = 0;
+    while (i < pocadv_cmd_count) {
+        const PocadvDrawCmd *run = &pocadv_cmds[i];
+        int n = 1;
+        while (i + n < pocadv_cmd_count && pocadv_same_state(run, &pocadv_cmds[i + n])) n++;
 
-        // Sort intersections
-        for (int i = 0; i < n_intersections - 1; i++) {
-            for (int j = i + 1; j < n_intersections; j++) {
-                if (intersections[j] < intersections[i]) {
-                    int tmp = intersections[i];
-                    intersections[i] = intersections[j];
-                    intersections[j] = tmp;
-                }
-            }
+        if (run->kind != POCADV_CMD_GEOMETRY && (!have_color || run->color != color)) {
+            have_color = 1;
+            color = run->color;
+            SDL_SetRenderDrawColor(pocadv_renderer,
+                                   (run->color >> 24) & 0xFF, (run->color >> 16) & 0xFF,
+                                   (run->color >> 8) & 0xFF, run->color & 0xFF);
         }
 
-        for (int i = 0; i < n_intersections; i += 2) {
-            if (i + 1 < n_intersections) {
-                SDL_RenderDrawLine(pocadv_renderer, intersections[i], y, intersections[i + 1], y);
-            }
+        switch (run->kind) {
+            case POCADV_CMD_POINTS:     pocadv_flush_points(run, n); break;
+            case POCADV_CMD_LINES:      pocadv_flush_lines(run, n); break;
+            case POCADV_CMD_RECTS:      pocadv_flush_rects(run, n, 0); break;
+            case POCADV_CMD_FILL_RECTS: pocadv_flush_rects(run, n, 1); break;
+            case POCADV_CMD_GEOMETRY:   pocadv_flush_geometry(run, n); break;
         }
+        i += n;
     }
-}
 
-// ----------------------- Timing ----------------------
+    pocadv_cmd_count = 0;
+    pocadv_cmd_point_count = 0;
+    pocadv_cmd_rect_count = 0;
+    pocadv_cmd_vertex_count = 0;
+    pocadv_cmd_index_count = 0;
+}
 
-float pocadv_get_delta_time() {
-    Uint64 current_counter = SDL_GetPerformanceCounter();
-    Uint64 counter_diff = current_counter - pocadv_last_counter;
-    Uint64 freq = SDL_GetPerformanceFrequency();
-    pocadv_delta_time = (float)counter_diff / (float)freq;
-    pocadv_last_counter = current_counter;
-    return pocadv_delta_time;
+void pocadv_set_deferred(int enabled) {
+    if (pocadv_soft) return; // rasterizing has no per-call cost to batch away
+    if (pocadv_deferred && !enabled) {
+        pocadv_flush();
+        // Immediate draws use the renderer's colour, which only replays set
+        SDL_SetRenderDrawColor(pocadv_renderer, pocadv_draw_color.r, pocadv_draw_color.g,
+                               pocadv_draw_color.b, pocadv_draw_color.a);
+    }
+    pocadv_deferred = enabled;
 }
 
+static void pocadv_free_draw_commands() {
+    free(pocadv_cmds);
+    free(pocadv_cmd_points);
+    free(pocadv_cmd_rects);
+    free(pocadv_cmd_vertices);
+    free(pocadv_cmd_indices);
+    free(pocadv_merge_points);
+    free(pocadv_merge_rects);
+    free(pocadv_merge_vertices);
+    free(pocadv_merge_indices);
+    free(pocadv_shape_points);
+    free(pocadv_shape_vertices);
+    free(pocadv_shape_indices);
+    free(pocadv_poly_edges);
+    free(pocadv_poly_active);
+    free(pocadv_poly_spans);
 
-// Audio implementation
+    pocadv_cmds = NULL;
+    pocadv_cmd_points = NULL;
+    pocadv_cmd_rects = NULL;
+    pocadv_cmd_vertices = NULL;
+    pocadv_cmd_indices = NULL;
+    pocadv_merge_points = NULL;
+    pocadv_merge_rects = NULL;
+    pocadv_merge_vertices = NULL;
+    pocadv_merge_indices = NULL;
+    pocadv_shape_points = NULL;
+    pocadv_shape_vertices = NULL;
+    pocadv_shape_indices = NULL;
+    pocadv_poly_edges = NULL;
+    pocadv_poly_active = NULL;
+    pocadv_poly_spans = NULL;
 
-pocadv_Audio* pocadv_audio_load(const char *file) {
-    if (!file) return NULL;
+    pocadv_cmd_count = pocadv_cmd_capacity = 0;
+    pocadv_cmd_point_count = pocadv_cmd_point_capacity = 0;
+    pocadv_cmd_rect_count = pocadv_cmd_rect_capacity = 0;
+    pocadv_cmd_vertex_count = pocadv_cmd_vertex_capacity = 0;
+    pocadv_cmd_index_count = pocadv_cmd_index_capacity = 0;
+    pocadv_merge_point_capacity = pocadv_merge_rect_capacity = 0;
+    pocadv_merge_vertex_capacity = pocadv_merge_index_capacity = 0;
+    pocadv_shape_point_capacity = pocadv_shape_vertex_capacity = pocadv_shape_index_capacity = 0;
+    pocadv_poly_edge_capacity = pocadv_poly_active_capacity = pocadv_poly_span_capacity = 0;
+}
 
-    pocadv_Audio *audio = (pocadv_Audio*)malloc(sizeof(pocadv_Audio));
-    if (!audio) return NULL;
+// ----------------------- Software backend ----------------------
 
-    audio->buffer = NULL;
-    audio->length = 0;
-    audio->device = 0;
-    audio->loops_remaining = 0;
+static Uint32 pocadv_soft_color(SDL_Color c) {
+    return ((Uint32)c.a << 24) | ((Uint32)c.r << 16) | ((Uint32)c.g << 8) | c.b;
+}
 
-    if (SDL_LoadWAV(file, &audio->spec, &audio->buffer, &audio->length) == NULL) {
-        free(audio);
-        return NULL;
-    }
+// Span kernels: fill n pixels with a colour, or copy n pixels skipping the
+// ones with alpha 0. The widest version the CPU supports is picked at init.
+static void pocadv_fill_span_scalar(Uint32 *dst, Uint32 color, int n) {
+    for (int i = 0; i < n; i++) dst[i] = color;
+}
 
-    // Open audio device for playback with WAV's spec
-    audio->device = SDL_OpenAudioDevice(NULL, 0, &audio->spec, NULL, 0);
-    if (audio->device == 0) {
-        SDL_FreeWAV(audio->buffer);
-        free(audio);
-        return NULL;
+static void pocadv_key_span_scalar(Uint32 *dst, const Uint32 *src, int n) {
+    for (int i = 0; i < n; i++) {
+        if (src[i] >> 24) dst[i] = src[i];
     }
-    return audio;
 }
 
-// Modified to accept loop_count:
-//  loop_count == 0 means infinite loop
-int pocadv_audio_play(pocadv_Audio *audio, int loop_count) {
-    if (!audio || audio->device == 0) return -1;
+#ifdef POCADV_X86
 
-    if (loop_count == 0)
-        audio->loops_remaining = -1; // infinite loops
-    else
-        audio->loops_remaining = loop_count;
+#if defined(__GNUC__) || defined(__clang__)
+#define POCADV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define POCADV_TARGET(isa)
+#endif
 
-    SDL_ClearQueuedAudio(audio->device);
+POCADV_TARGET("sse2")
+static void pocadv_fill_span_sse2(Uint32 *dst, Uint32 color, int n) {
+    __m128i c = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i*)(dst + i), c);
+    for (; i < n; i++) dst[i] = color;
+}
 
-    if (SDL_QueueAudio(audio->device, audio->buffer, audio->length) < 0) {
-        return -1;
+POCADV_TARGET("sse2")
+static void pocadv_key_span_sse2(Uint32 *dst, const Uint32 *src, int n) {
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s, alpha), zero);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
     }
-
-    SDL_PauseAudioDevice(audio->device, 0); // Start playing
-    return 0;
+    pocadv_key_span_scalar(dst + i, src + i, n - i);
 }
 
-// Call this regularly (e.g. once per frame) to maintain looping playback
-void pocadv_audio_update(pocadv_Audio *audio) {
-    if (!audio || audio->device == 0) return;
+POCADV_TARGET("avx2")
+static void pocadv_fill_span_avx2(Uint32 *dst, Uint32 color, int n) {
+    __m256i c = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256((__m256i*)(dst + i), c);
+    for (; i < n; i++) dst[i] = color;
+}
 
-    Uint32 queued = SDL_GetQueuedAudioSize(audio->device);
-    if (queued == 0) {
-        if (audio->loops_remaining == 0) {
-            SDL_PauseAudioDevice(audio->device, 1); // stop playback
-        } else {
-            if (audio->loops_remaining > 0)
-                audio->loops_remaining--;
-            SDL_QueueAudio(audio->device, audio->buffer, audio->length);
-            SDL_PauseAudioDevice(audio->device, 0); // ensure playing
-        }
+POCADV_TARGET("avx2")
+static void pocadv_key_span_avx2(Uint32 *dst, const Uint32 *src, int n) {
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), zero);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, d, keep));
     }
+    pocadv_key_span_scalar(dst + i, src + i, n - i);
 }
 
-void pocadv_audio_stop(pocadv_Audio *audio) {
-    if (!audio || audio->device == 0) return;
+#endif // POCADV_X86
 
-    SDL_ClearQueuedAudio(audio->device);
-    SDL_PauseAudioDevice(audio->device, 1);
-}
+static int pocadv_soft_init(int width, int height) {
+    pocadv_fb = (Uint32*)calloc((size_t)width * height, sizeof(Uint32));
+    if (!pocadv_fb) return -1;
 
-void pocadv_audio_pause(pocadv_Audio *audio) {
-    if (!audio || audio->device == 0) return;
+    pocadv_fb_texture = SDL_CreateTexture(pocadv_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (!pocadv_fb_texture) {
+        free(pocadv_fb);
+        pocadv_fb = NULL;
+        return -1;
+    }
+    // The framebuffer replaces the whole backbuffer, which is never cleared,
+    // so its alpha must not blend with what was there
+    SDL_SetTextureBlendMode(pocadv_fb_texture, SDL_BLENDMODE_NONE);
+
+    pocadv_fb_w = width;
+    pocadv_fb_h = height;
+    pocadv_soft = 1;
 
-    SDL_PauseAudioDevice(audio->device, 1);
+    pocadv_fill_span = pocadv_fill_span_scalar;
+    pocadv_key_span = pocadv_key_span_scalar;
+#ifdef POCADV_X86
+    if (SDL_HasAVX2()) {
+        pocadv_fill_span = pocadv_fill_span_avx2;
+        pocadv_key_span = pocadv_key_span_avx2;
+    } else if (SDL_HasSSE2()) {
+        pocadv_fill_span = pocadv_fill_span_sse2;
+        pocadv_key_span = pocadv_key_span_sse2;
+    }
+#endif
+    return 0;
 }
 
-void pocadv_audio_unpause(pocadv_Audio *audio) {
-    if (!audio || audio->device == 0) return;
+static void pocadv_soft_quit() {
+    for (int i = 0; i < pocadv_soft_image_count; i++) free(pocadv_soft_images[i].pixels);
+    free(pocadv_soft_images);
+    pocadv_soft_images = NULL;
+    pocadv_soft_image_count = pocadv_soft_image_capacity = 0;
 
-    SDL_PauseAudioDevice(audio->device, 0);
+    if (pocadv_fb_texture) SDL_DestroyTexture(pocadv_fb_texture);
+    free(pocadv_fb);
+    pocadv_fb_texture = NULL;
+    pocadv_fb = NULL;
+    pocadv_fb_w = pocadv_fb_h = 0;
+    pocadv_soft = 0;
 }
 
-void pocadv_audio_free(pocadv_Audio *audio) {
-    if (!audio) return;
+// Keeps a CPU copy of a texture's pixels for the software backend. `surf`
+// is the surface the texture was created from; its colour key becomes alpha 0.
+static int pocadv_soft_register(SDL_Texture *tex, SDL_Surface *surf) {
+    if (!pocadv_soft) return 0;
+    if (pocadv_reserve((void**)&pocadv_soft_images, &pocadv_soft_image_capacity,
+                       pocadv_soft_image_count + 1, sizeof(PocadvSoftImage)) < 0) return -1;
+
+    SDL_Surface *argb = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!argb) return -1;
+    Uint32 *pixels = (Uint32*)malloc((size_t)argb->w * argb->h * sizeof(Uint32));
+    if (!pixels) {
+        SDL_FreeSurface(argb);
+        return -1;
+    }
 
-    if (audio->device != 0) {
-        SDL_CloseAudioDevice(audio->device);
-        audio->device = 0;
+    Uint32 key = 0;
+    int keyed = SDL_GetColorKey(surf, &key) == 0;
+    if (keyed) {
+        Uint8 r, g, b;
+        SDL_GetRGB(key, surf->format, &r, &g, &b);
+        key = ((Uint32)r << 16) | ((Uint32)g << 8) | b;
     }
-    if (audio->buffer) {
-        SDL_FreeWAV(audio->buffer);
-        audio->buffer = NULL;
+
+    for (int y = 0; y < argb->h; y++) {
+        const Uint32 *row = (const Uint32*)((const Uint8*)argb->pixels + y * argb->pitch);
+        Uint32 *out = pixels + y * argb->w;
+        for (int x = 0; x < argb->w; x++) {
+            out[x] = keyed && (row[x] & 0x00FFFFFF) == key ? 0 : row[x];
+        }
     }
-    free(audio);
+
+    PocadvSoftImage *img = &pocadv_soft_images[pocadv_soft_image_count++];
+    img->texture = tex;
+    img->pixels = pixels;
+    img->w = argb->w;
+    img->h = argb->h;
+    SDL_FreeSurface(argb);
+    return 0;
+}
+
+static PocadvSoftImage* pocadv_soft_image(SDL_Texture *tex) {
+    for (int i = 0; i < pocadv_soft_image_count; i++) {
+        if (pocadv_soft_images[i].texture == tex) return &pocadv_soft_images[i];
+    }
+    return NULL;
+}
+
+// Drops the software backend's copy of a texture's pixels
+static void pocadv_soft_forget(SDL_Texture *tex) {
+    PocadvSoftImage *img = pocadv_soft_image(tex);
+    if (img) {
+        free(img->pixels);
+        *img = pocadv_soft_images[--pocadv_soft_image_count];
+    }
+}
+
+// Every texture pocadv creates is destroyed through here, so the software
+// backend never keeps pixels for a texture that is gone, and no recorded
+// draw is left pointing at one
+static void pocadv_destroy_texture(SDL_Texture *tex) {
+    for (int i = 0; i < pocadv_cmd_count; i++) {
+        if (pocadv_cmds[i].texture == tex) {
+            pocadv_flush();
+            break;
+        }
+    }
+
+    pocadv_soft_forget(tex);
+    SDL_DestroyTexture(tex);
+}
+
+// Fills [x0, x1) on row y, clipped to the framebuffer
+static void pocadv_soft_hspan(int x0, int x1, int y, Uint32 color) {
+    if (y < 0 || y >= pocadv_fb_h) return;
+    if (x0 < 0) x0 = 0;
+    if (x1 > pocadv_fb_w) x1 = pocadv_fb_w;
+    if (x0 < x1) pocadv_fill_span(pocadv_fb + y * pocadv_fb_w + x0, color, x1 - x0);
+}
+
+static void pocadv_soft_fill_rect(int x, int y, int w, int h, Uint32 color) {
+    int y0 = y < 0 ? 0 : y;
+    int y1 = y + h > pocadv_fb_h ? pocadv_fb_h : y + h;
+    for (int row = y0; row < y1; row++) pocadv_soft_hspan(x, x + w, row, color);
+}
+
+static void pocadv_soft_plot(int x, int y, Uint32 color) {
+    if ((unsigned)x < (unsigned)pocadv_fb_w && (unsigned)y < (unsigned)pocadv_fb_h)
+        pocadv_fb[y * pocadv_fb_w + x] = color;
+}
+
+// Bresenham, both end points included like SDL_RenderDrawLine
+static void pocadv_soft_line(int x0, int y0, int x1, int y1, Uint32 color) {
+    if (y0 == y1) {
+        if (x0 > x1) {
+            int t = x0;
+            x0 = x1;
+            x1 = t;
+        }
+        pocadv_soft_hspan(x0, x1 + 1, y0, color);
+        return;
+    }
+
+    int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    for (;;) {
+        pocadv_soft_plot(x0, y0, color);
+        if (x0 == x1 && y0 == y1) break;
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
+
+static void pocadv_soft_points(const SDL_Point *points, int count) {
+    Uint32 color = pocadv_soft_color(pocadv_draw_color);
+    for (int i = 0; i < count; i++) pocadv_soft_plot(points[i].x, points[i].y, color);
+}
+
+static void pocadv_soft_lines(const SDL_Point *points, int count) {
+    Uint32 color = pocadv_soft_color(pocadv_draw_color);
+    for (int i = 0; i + 1 < count; i++) {
+        pocadv_soft_line(points[i].x, points[i].y, points[i + 1].x, points[i + 1].y, color);
+    }
+}
+
+static void pocadv_soft_rects(const SDL_Rect *rects, int count, int filled) {
+    Uint32 color = pocadv_soft_color(pocadv_draw_color);
+    for (int i = 0; i < count; i++) {
+        const SDL_Rect *r = &rects[i];
+        if (r->w <= 0 || r->h <= 0) continue;
+        if (filled) {
+            pocadv_soft_fill_rect(r->x, r->y, r->w, r->h, color);
+            continue;
+        }
+        pocadv_soft_hspan(r->x, r->x + r->w, r->y, color);
+        if (r->h > 1) pocadv_soft_hspan(r->x, r->x + r->w, r->y + r->h - 1, color);
+        for (int y = r->y + 1; y < r->y + r->h - 1; y++) {
+            pocadv_soft_plot(r->x, y, color);
+            pocadv_soft_plot(r->x + r->w - 1, y, color);
+        }
+    }
+}
+
+// Unscaled colour-keyed copy; src and dst have the same size
+static void pocadv_soft_copy(SDL_Texture *tex, const SDL_Rect *src, const SDL_Rect *dst) {
+    const PocadvSoftImage *img = pocadv_soft_image(tex);
+    if (!img) return;
+
+    int sx = src->x, sy = src->y, w = src->w, h = src->h;
+    int dx = dst->x, dy = dst->y;
+
+    // Clip against the image, then against the framebuffer
+    if (sx < 0) { dx -= sx; w += sx; sx = 0; }
+    if (sy < 0) { dy -= sy; h += sy; sy = 0; }
+    if (sx + w > img->w) w = img->w - sx;
+    if (sy + h > img->h) h = img->h - sy;
+    if (dx < 0) { sx -= dx; w += dx; dx = 0; }
+    if (dy < 0) { sy -= dy; h += dy; dy = 0; }
+    if (dx + w > pocadv_fb_w) w = pocadv_fb_w - dx;
+    if (dy + h > pocadv_fb_h) h = pocadv_fb_h - dy;
+    if (w <= 0 || h <= 0) return;
+
+    for (int y = 0; y < h; y++) {
+        pocadv_key_span(pocadv_fb + (dy + y) * pocadv_fb_w + dx,
+                        img->pixels + (sy + y) * img->w + sx, w);
+    }
+}
+
+static int pocadv_same_color(SDL_Color a, SDL_Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// Fills the pixels whose centres fall inside the triangle. Untextured
+// single-colour triangles (circle fans) become plain span fills; otherwise
+// colour and texture coordinates are interpolated across the triangle and
+// texels are sampled nearest, modulated by the colour, and skipped when
+// transparent.
+static void pocadv_soft_triangle(const SDL_Vertex *a, const SDL_Vertex *b, const SDL_Vertex *c,
+                                 const PocadvSoftImage *img) {
+    const SDL_Vertex *t;
+    if (b->position.y < a->position.y) { t = a; a = b; b = t; }
+    if (c->position.y < a->position.y) { t = a; a = c; c = t; }
+    if (c->position.y < b->position.y) { t = b; b = c; c = t; }
+
+    float ax = a->position.x, ay = a->position.y;
+    float bx = b->position.x, by = b->position.y;
+    float cx = c->position.x, cy = c->position.y;
+    float det = (bx - ax) * (cy - ay) - (cx - ax) * (by - ay);
+    if (det == 0.0f) return;
+
+    int y0 = (int)SDL_ceilf(ay - 0.5f), y1 = (int)SDL_ceilf(cy - 0.5f);
+    if (y0 < 0) y0 = 0;
+    if (y1 > pocadv_fb_h) y1 = pocadv_fb_h;
+
+    int flat = !img && pocadv_same_color(a->color, b->color) && pocadv_same_color(a->color, c->color);
+    Uint32 flat_color = pocadv_soft_color(a->color);
+
+    // Attribute planes: r, g, b, a, u, v as f0 + dx * (x - ax) + dy * (y - ay)
+    float f0[6], fdx[6], fdy[6];
+    if (!flat) {
+        const SDL_Vertex *v[3] = {a, b, c};
+        float f[3][6];
+        for (int k = 0; k < 3; k++) {
+            f[k][0] = v[k]->color.r;
+            f[k][1] = v[k]->color.g;
+            f[k][2] = v[k]->color.b;
+            f[k][3] = v[k]->color.a;
+            f[k][4] = v[k]->tex_coord.x;
+            f[k][5] = v[k]->tex_coord.y;
+        }
+        for (int i = 0; i < 6; i++) {
+            f0[i] = f[0][i];
+            fdx[i] = ((f[1][i] - f[0][i]) * (cy - ay) - (f[2][i] - f[0][i]) * (by - ay)) / det;
+            fdy[i] = ((f[2][i] - f[0][i]) * (bx - ax) - (f[1][i] - f[0][i]) * (cx - ax)) / det;
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        float yc = y + 0.5f;
+        float xl = ax + (cx - ax) * (yc - ay) / (cy - ay);
+        float xr = yc < by ? ax + (bx - ax) * (yc - ay) / (by - ay)
+                           : bx + (cx - bx) * (yc - by) / (cy - by);
+        if (xr < xl) { float tmp = xl; xl = xr; xr = tmp; }
+
+        int x0 = (int)SDL_ceilf(xl - 0.5f), x1 = (int)SDL_ceilf(xr - 0.5f);
+        if (x0 < 0) x0 = 0;
+        if (x1 > pocadv_fb_w) x1 = pocadv_fb_w;
+        if (x0 >= x1) continue;
+
+        Uint32 *row = pocadv_fb + y * pocadv_fb_w;
+        if (flat) {
+            pocadv_fill_span(row + x0, flat_color, x1 - x0);
+            continue;
+        }
+
+        float val[6];
+        for (int i = 0; i < 6; i++) val[i] = f0[i] + fdx[i] * (x0 + 0.5f - ax) + fdy[i] * (yc - ay);
+
+        for (int x = x0; x < x1; x++) {
+            Uint32 cr = (Uint32)SDL_clamp((int)val[0], 0, 255);
+            Uint32 cg = (Uint32)SDL_clamp((int)val[1], 0, 255);
+            Uint32 cb = (Uint32)SDL_clamp((int)val[2], 0, 255);
+            Uint32 ca = (Uint32)SDL_clamp((int)val[3], 0, 255);
+            float u = val[4], v = val[5];
+            for (int i = 0; i < 6; i++) val[i] += fdx[i];
+
+            if (img) {
+                int tx = SDL_clamp((int)SDL_floorf(u * img->w), 0, img->w - 1);
+                int ty = SDL_clamp((int)SDL_floorf(v * img->h), 0, img->h - 1);
+                Uint32 texel = img->pixels[ty * img->w + tx];
+                ca = (ca * (texel >> 24) + 255) >> 8;
+                if (ca == 0) continue;
+                cr = (cr * ((texel >> 16) & 0xFF) + 255) >> 8;
+                cg = (cg * ((texel >> 8) & 0xFF) + 255) >> 8;
+                cb = (cb * (texel & 0xFF) + 255) >> 8;
+            }
+            row[x] = (ca << 24) | (cr << 16) | (cg << 8) | cb;
+        }
+    }
+}
+
+static void pocadv_soft_geometry(SDL_Texture *tex, const SDL_Vertex *vertices,
+                                 const int *indices, int num_indices) {
+    const PocadvSoftImage *img = NULL;
+    if (tex) {
+        img = pocadv_soft_image(tex);
+        if (!img) return;
+    }
+    for (int i = 0; i + 2 < num_indices; i += 3) {
+        pocadv_soft_triangle(&vertices[indices[i]], &vertices[indices[i + 1]],
+                             &vertices[indices[i + 2]], img);
+    }
+}
+
+Uint32* pocadv_get_framebuffer(int *width, int *height) {
+    if (width) *width = pocadv_fb_w;
+    if (height) *height = pocadv_fb_h;
+    return pocadv_fb;
+}
+
+// ----------------------- Rendering ----------------------
+
+void pocadv_clear() {
+    pocadv_draw_color = (SDL_Color){0, 0, 0, 255};
+
+    if (pocadv_soft) {
+        pocadv_fill_span(pocadv_fb, pocadv_soft_color(pocadv_draw_color), pocadv_fb_w * pocadv_fb_h);
+        return;
+    }
+
+    if (pocadv_deferred) {
+        // Anything recorded so far would be cleared away anyway
+        pocadv_cmd_count = 0;
+        pocadv_cmd_point_count = 0;
+        pocadv_cmd_rect_count = 0;
+        pocadv_cmd_vertex_count = 0;
+        pocadv_cmd_index_count = 0;
+        pocadv_clear_pending = 1;
+        return;
+    }
+
+    SDL_SetRenderDrawColor(pocadv_renderer, 0, 0, 0, 255);
+    SDL_RenderClear(pocadv_renderer);
+}
+
+void pocadv_present() {
+    if (pocadv_deferred) pocadv_flush();
+    // Headless, the framebuffer already is the frame
+    if (pocadv_soft && !pocadv_target) {
+        SDL_UpdateTexture(pocadv_fb_texture, NULL, pocadv_fb, pocadv_fb_w * (int)sizeof(Uint32));
+        SDL_RenderCopy(pocadv_renderer, pocadv_fb_texture, NULL, NULL);
+    }
+    SDL_RenderPresent(pocadv_renderer);
+}
+
+int pocadv_dump_frame(const char *file) {
+    if (!file) return -1;
+    if (pocadv_deferred) pocadv_flush();
+
+    SDL_Surface *frame = NULL;
+    if (pocadv_soft) {
+        frame = SDL_CreateRGBSurfaceWithFormatFrom(pocadv_fb, pocadv_fb_w, pocadv_fb_h, 32,
+                                                   pocadv_fb_w * (int)sizeof(Uint32),
+                                                   SDL_PIXELFORMAT_ARGB8888);
+    } else if (pocadv_target) {
+        return SDL_SaveBMP(pocadv_target, file);
+    } else {
+        int w, h;
+        if (SDL_GetRendererOutputSize(pocadv_renderer, &w, &h) != 0) return -1;
+        frame = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (frame && SDL_RenderReadPixels(pocadv_renderer, NULL, SDL_PIXELFORMAT_ARGB8888,
+                                          frame->pixels, frame->pitch) != 0) {
+            SDL_FreeSurface(frame);
+            return -1;
+        }
+    }
+    if (!frame) return -1;
+
+    int result = SDL_SaveBMP(frame, file);
+    SDL_FreeSurface(frame);
+    return result;
+}
+
+// FNV-1a, so lookups only compare strings when the hashes match
+static Uint32 pocadv_hash_string(const char *str) {
+    Uint32 hash = 2166136261u;
+    for (; *str; str++) {
+        hash ^= (Uint8)*str;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Fills in a handle covering the whole of an SDL texture
+static int pocadv_texture_wrap(pocadv_Texture *tex, SDL_Texture *sdl) {
+    int access;
+    if (SDL_QueryTexture(sdl, &tex->format, &access, &tex->tex_w, &tex->tex_h) != 0) return -1;
+    if (SDL_GetTextureBlendMode(sdl, &tex->blend) != 0) tex->blend = SDL_BLENDMODE_NONE;
+
+    tex->texture = sdl;
+    tex->rect = (SDL_Rect){0, 0, tex->tex_w, tex->tex_h};
+    tex->uv = (SDL_FRect){0.0f, 0.0f, 1.0f, 1.0f};
+    return 0;
+}
+
+pocadv_Texture pocadv_texture_clip(const pocadv_Texture *tex, SDL_Rect clip) {
+    pocadv_Texture t = *tex;
+    t.rect = (SDL_Rect){tex->rect.x + clip.x, tex->rect.y + clip.y, clip.w, clip.h};
+    t.uv.x = (float)t.rect.x / tex->tex_w;
+    t.uv.y = (float)t.rect.y / tex->tex_h;
+    t.uv.w = (float)t.rect.w / tex->tex_w;
+    t.uv.h = (float)t.rect.h / tex->tex_h;
+    return t;
+}
+
+pocadv_Texture* pocadv_load_texture(const char *file) {
+    if (!file) return NULL;
+
+    Uint32 hash = pocadv_hash_string(file);
+    for (int i = 0; i < pocadv_texture_count; i++) {
+        PocadvTextureEntry *e = &pocadv_textures[i];
+        if (e->hash == hash && strcmp(e->path, file) == 0) {
+            e->refs++;
+            pocadv_texture_hits++;
+            return e->texture;
+        }
+    }
+    pocadv_texture_misses++;
+
+    // Handles live in their own allocation so they don't move when the
+    // cache grows
+    pocadv_Texture *tex = (pocadv_Texture*)malloc(sizeof(pocadv_Texture));
+    char *path = (char*)malloc(strlen(file) + 1);
+    if (!tex || !path || pocadv_reserve((void**)&pocadv_textures, &pocadv_texture_capacity,
+                                        pocadv_texture_count + 1, sizeof(PocadvTextureEntry)) < 0) {
+        free(tex);
+        free(path);
+        return NULL;
+    }
+    strcpy(path, file);
+
+    SDL_Surface *surf = SDL_LoadBMP(file);
+    SDL_Texture *sdl = NULL;
+    if (surf) {
+        SDL_SetColorKey(surf, SDL_TRUE, SDL_MapRGB(surf->format, 0xFF, 0x00, 0xFF));
+        sdl = SDL_CreateTextureFromSurface(pocadv_renderer, surf);
+        if (sdl && pocadv_soft_register(sdl, surf) < 0) {
+            SDL_DestroyTexture(sdl);
+            sdl = NULL;
+        }
+        SDL_FreeSurface(surf);
+    }
+    if (!sdl || pocadv_texture_wrap(tex, sdl) < 0) {
+        if (sdl) pocadv_destroy_texture(sdl);
+        free(tex);
+        free(path);
+        return NULL;
+    }
+
+    PocadvTextureEntry *e = &pocadv_textures[pocadv_texture_count++];
+    e->path = path;
+    e->hash = hash;
+    e->texture = tex;
+    e->refs = 1;
+    return tex;
+}
+
+void pocadv_texture_release(pocadv_Texture *tex) {
+    if (!tex) return;
+
+    for (int i = 0; i < pocadv_texture_count; i++) {
+        PocadvTextureEntry *e = &pocadv_textures[i];
+        if (e->texture != tex) continue;
+
+        if (--e->refs > 0) return;
+
+        pocadv_destroy_texture(e->texture->texture);
+        free(e->texture);
+        free(e->path);
+        pocadv_textures[i] = pocadv_textures[--pocadv_texture_count];
+        return;
+    }
+}
+
+void pocadv_texture_cache_stats(int *hits, int *misses) {
+    if (hits) *hits = pocadv_texture_hits;
+    if (misses) *misses = pocadv_texture_misses;
+}
+
+static void pocadv_free_textures() {
+    for (int i = 0; i < pocadv_texture_count; i++) {
+        pocadv_destroy_texture(pocadv_textures[i].texture->texture);
+        free(pocadv_textures[i].texture);
+        free(pocadv_textures[i].path);
+    }
+    free(pocadv_textures);
+    pocadv_textures = NULL;
+    pocadv_texture_count = 0;
+    pocadv_texture_capacity = 0;
+}
+
+void pocadv_draw_texture(const pocadv_Texture *tex, int x, int y) {
+    if (!tex) return;
+    SDL_Rect dst = {x, y, tex->rect.w, tex->rect.h};
+    pocadv_submit_copy(tex, &tex->rect, &dst);
+}
+
+void pocadv_draw_texture_clipped(const pocadv_Texture *tex, int x, int y, const SDL_Rect *clip) {
+    if (!tex || !clip) return;
+    SDL_Rect src = {tex->rect.x + clip->x, tex->rect.y + clip->y, clip->w, clip->h};
+    SDL_Rect dst = {x, y, clip->w, clip->h};
+    pocadv_submit_copy(tex, &src, &dst);
+}
+
+// ----------------------- Texture atlas ----------------------
+
+#define POCADV_ATLAS_PAGE_SIZE 1024
+#define POCADV_ATLAS_PADDING 1 // keeps filtering from bleeding between images
+
+// Skyline packer: the page is described by the top edge of what has been
+// placed so far, as a list of horizontal segments from left to right
+typedef struct {
+    int x, y, w;
+} PocadvSkylineNode;
+
+typedef struct {
+    PocadvSkylineNode *nodes;
+    int count;
+    int capacity;
+    int w, h;             // page size
+    int used_w, used_h;   // extent actually covered by images
+} PocadvSkyline;
+
+// Returns the lowest y at which a w x h box fits starting at node i, or -1
+static int pocadv_skyline_fit(const PocadvSkyline *sky, int i, int w, int h) {
+    int x = sky->nodes[i].x;
+    if (x + w > sky->w) return -1;
+
+    int y = 0;
+    int remaining = w;
+    while (remaining > 0) {
+        if (i >= sky->count) return -1;
+        if (sky->nodes[i].y > y) y = sky->nodes[i].y;
+        if (y + h > sky->h) return -1;
+        remaining -= sky->nodes[i].w;
+        i++;
+    }
+    return y;
+}
+
+// Places a w x h box bottom-left style; returns -1 if the page is full
+static int pocadv_skyline_insert(PocadvSkyline *sky, int w, int h, SDL_Rect *out) {
+    int best = -1, best_x = 0, best_y = 0;
+    for (int i = 0; i < sky->count; i++) {
+        int y = pocadv_skyline_fit(sky, i, w, h);
+        if (y < 0) continue;
+        if (best < 0 || y < best_y || (y == best_y && sky->nodes[i].x < best_x)) {
+            best = i;
+            best_x = sky->nodes[i].x;
+            best_y = y;
+        }
+    }
+    if (best < 0) return -1;
+
+    if (pocadv_reserve((void**)&sky->nodes, &sky->capacity, sky->count + 1, sizeof(PocadvSkylineNode)) < 0)
+        return -1;
+
+    // New segment on top of the box, then trim the segments it covers
+    memmove(&sky->nodes[best + 1], &sky->nodes[best], (sky->count - best) * sizeof(PocadvSkylineNode));
+    sky->nodes[best] = (PocadvSkylineNode){best_x, best_y + h, w};
+    sky->count++;
+
+    for (int i = best + 1; i < sky->count; i++) {
+        PocadvSkylineNode *prev = &sky->nodes[i - 1];
+        PocadvSkylineNode *node = &sky->nodes[i];
+        int overlap = prev->x + prev->w - node->x;
+        if (overlap <= 0) break;
+
+        node->x += overlap;
+        node->w -= overlap;
+        if (node->w > 0) break;
+
+        memmove(node, node + 1, (sky->count - i - 1) * sizeof(PocadvSkylineNode));
+        sky->count--;
+        i--;
+    }
+
+    // Merge neighbours of equal height
+    for (int i = 0; i + 1 < sky->count; i++) {
+        if (sky->nodes[i].y == sky->nodes[i + 1].y) {
+            sky->nodes[i].w += sky->nodes[i + 1].w;
+            memmove(&sky->nodes[i + 1], &sky->nodes[i + 2], (sky->count - i - 2) * sizeof(PocadvSkylineNode));
+            sky->count--;
+            i--;
+        }
+    }
+
+    *out = (SDL_Rect){best_x, best_y, w, h};
+    if (best_x + w > sky->used_w) sky->used_w = best_x + w;
+    if (best_y + h > sky->used_h) sky->used_h = best_y + h;
+    return 0;
+}
+
+static int pocadv_skyline_page(PocadvSkyline *sky, int w, int h) {
+    sky->nodes = NULL;
+    sky->count = 0;
+    sky->capacity = 0;
+    if (pocadv_reserve((void**)&sky->nodes, &sky->capacity, 1, sizeof(PocadvSkylineNode)) < 0) return -1;
+    sky->nodes[0] = (PocadvSkylineNode){0, 0, w};
+    sky->count = 1;
+    sky->w = w;
+    sky->h = h;
+    sky->used_w = 0;
+    sky->used_h = 0;
+    return 0;
+}
+
+static SDL_Surface **pocadv_atlas_surfaces = NULL; // only valid during a build
+
+static int pocadv_atlas_compare(const void *a, const void *b) {
+    const SDL_Surface *sa = pocadv_atlas_surfaces[*(const int*)a];
+    const SDL_Surface *sb = pocadv_atlas_surfaces[*(const int*)b];
+    if (sa->h != sb->h) return sb->h - sa->h;
+    if (sa->w != sb->w) return sb->w - sa->w;
+    return *(const int*)a - *(const int*)b;
+}
+
+pocadv_Atlas* pocadv_atlas_build(const char *files[], int n) {
+    if (!files || n <= 0) return NULL;
+
+    pocadv_Atlas *atlas = (pocadv_Atlas*)calloc(1, sizeof(pocadv_Atlas));
+    SDL_Surface **surfaces = (SDL_Surface**)calloc(n, sizeof(SDL_Surface*));
+    int *order = (int*)malloc(n * sizeof(int));
+    int *page_of = (int*)malloc(n * sizeof(int));
+    PocadvSkyline *pages = NULL;
+    int page_count = 0, page_capacity = 0;
+    int ok = atlas && surfaces && order && page_of;
+
+    if (ok) {
+        atlas->regions = (pocadv_Region*)calloc(n, sizeof(pocadv_Region));
+        atlas->region_count = n;
+        ok = atlas->regions != NULL;
+    }
+
+    // Decode everything first so the packer can see all the sizes
+    for (int i = 0; ok && i < n; i++) {
+        surfaces[i] = SDL_LoadBMP(files[i]);
+        if (!surfaces[i]) {
+            ok = 0;
+            break;
+        }
+        SDL_SetColorKey(surfaces[i], SDL_TRUE, SDL_MapRGB(surfaces[i]->format, 0xFF, 0x00, 0xFF));
+        SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+        order[i] = i;
+    }
+
+    // Tallest first packs a skyline tightest
+    if (ok) {
+        pocadv_atlas_surfaces = surfaces;
+        qsort(order, n, sizeof(int), pocadv_atlas_compare);
+        pocadv_atlas_surfaces = NULL;
+    }
+
+    for (int k = 0; ok && k < n; k++) {
+        int i = order[k];
+        int w = surfaces[i]->w + POCADV_ATLAS_PADDING;
+        int h = surfaces[i]->h + POCADV_ATLAS_PADDING;
+        SDL_Rect placed;
+
+        int p = 0;
+        while (p < page_count && pocadv_skyline_insert(&pages[p], w, h, &placed) < 0) p++;
+
+        if (p == page_count) {
+            // Oversized images get a page of their own
+            int pw = w > POCADV_ATLAS_PAGE_SIZE ? w : POCADV_ATLAS_PAGE_SIZE;
+            int ph = h > POCADV_ATLAS_PAGE_SIZE ? h : POCADV_ATLAS_PAGE_SIZE;
+            if (pocadv_reserve((void**)&pages, &page_capacity, page_count + 1, sizeof(PocadvSkyline)) < 0 ||
+                pocadv_skyline_page(&pages[page_count], pw, ph) < 0) {
+                ok = 0;
+                break;
+            }
+            page_count++;
+            if (pocadv_skyline_insert(&pages[p], w, h, &placed) < 0) {
+                ok = 0;
+                break;
+            }
+        }
+
+        page_of[i] = p;
+        atlas->regions[i].rect = (SDL_Rect){placed.x, placed.y, surfaces[i]->w, surfaces[i]->h};
+    }
+
+    if (ok) {
+        atlas->pages = (SDL_Texture**)calloc(page_count, sizeof(SDL_Texture*));
+        ok = atlas->pages != NULL;
+    }
+
+    // Each page is only as large as the area its images cover
+    for (int p = 0; ok && p < page_count; p++) {
+        SDL_Surface *page = SDL_CreateRGBSurfaceWithFormat(0, pages[p].used_w, pages[p].used_h,
+                                                           32, SDL_PIXELFORMAT_ARGB8888);
+        if (!page) {
+            ok = 0;
+            break;
+        }
+        SDL_FillRect(page, NULL, SDL_MapRGBA(page->format, 0, 0, 0, 0));
+
+        for (int i = 0; i < n; i++) {
+            if (page_of[i] != p) continue;
+            SDL_Rect dst = atlas->regions[i].rect;
+            SDL_BlitSurface(surfaces[i], NULL, page, &dst);
+        }
+
+        atlas->pages[p] = SDL_CreateTextureFromSurface(pocadv_renderer, page);
+        if (atlas->pages[p] && pocadv_soft_register(atlas->pages[p], page) < 0) {
+            SDL_DestroyTexture(atlas->pages[p]);
+            atlas->pages[p] = NULL;
+        }
+        SDL_FreeSurface(page);
+        if (!atlas->pages[p]) {
+            ok = 0;
+            break;
+        }
+        SDL_SetTextureBlendMode(atlas->pages[p], SDL_BLENDMODE_BLEND);
+        atlas->page_count++;
+
+        // Regions are handles onto their page, covering just their image
+        pocadv_Texture handle;
+        if (pocadv_texture_wrap(&handle, atlas->pages[p]) < 0) {
+            ok = 0;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (page_of[i] == p) atlas->regions[i] = pocadv_texture_clip(&handle, atlas->regions[i].rect);
+        }
+    }
+
+    for (int i = 0; surfaces && i < n; i++) {
+        if (surfaces[i]) SDL_FreeSurface(surfaces[i]);
+    }
+    for (int p = 0; p < page_count; p++) free(pages[p].nodes);
+    free(pages);
+    free(page_of);
+    free(order);
+    free(surfaces);
+
+    if (!ok) {
+        pocadv_atlas_free(atlas);
+        return NULL;
+    }
+    return atlas;
+}
+
+void pocadv_atlas_free(pocadv_Atlas *atlas) {
+    if (!atlas) return;
+
+    for (int p = 0; p < atlas->page_count; p++) {
+        if (atlas->pages[p]) pocadv_destroy_texture(atlas->pages[p]);
+    }
+    free(atlas->pages);
+    free(atlas->regions);
+    free(atlas);
+}
+
+void pocadv_draw_region(const pocadv_Region *region, int x, int y) {
+    pocadv_draw_texture(region, x, y);
+}
+
+void pocadv_draw_region_clipped(const pocadv_Region *region, int x, int y, const SDL_Rect *clip) {
+    pocadv_draw_texture_clipped(region, x, y, clip);
+}
+
+// ----------------------- Sprite batching ----------------------
+
+void pocadv_batch_begin() {
+    pocadv_batch_count = 0;
+    pocadv_batching = 1;
+}
+
+void pocadv_batch_sprite(const pocadv_Texture *tex, int x, int y, const SDL_Rect *clip,
+                         SDL_Color tint, float angle, SDL_RendererFlip flip) {
+    if (!tex) return;
+
+    if (pocadv_reserve((void**)&pocadv_batch_sprites, &pocadv_batch_capacity,
+                       pocadv_batch_count + 1, sizeof(PocadvBatchSprite)) < 0) return;
+    if (pocadv_reserve((void**)&pocadv_batch_vertices, &pocadv_batch_vertex_capacity,
+                       (pocadv_batch_count + 1) * 4, sizeof(SDL_Vertex)) < 0) return;
+
+    float w, h, u0, u1, v0, v1;
+    if (clip) {
+        float su = 1.0f / tex->tex_w, sv = 1.0f / tex->tex_h;
+        w = (float)clip->w;
+        h = (float)clip->h;
+        u0 = (tex->rect.x + clip->x) * su;
+        v0 = (tex->rect.y + clip->y) * sv;
+        u1 = u0 + w * su;
+        v1 = v0 + h * sv;
+    } else {
+        w = (float)tex->rect.w;
+        h = (float)tex->rect.h;
+        u0 = tex->uv.x;
+        v0 = tex->uv.y;
+        u1 = u0 + tex->uv.w;
+        v1 = v0 + tex->uv.h;
+    }
+    if (flip & SDL_FLIP_HORIZONTAL) { float t = u0; u0 = u1; u1 = t; }
+    if (flip & SDL_FLIP_VERTICAL)   { float t = v0; v0 = v1; v1 = t; }
+
+    // Corners relative to the sprite centre, rotated when needed
+    float hw = w * 0.5f, hh = h * 0.5f;
+    float cx = x + hw, cy = y + hh;
+    float dx[4] = {-hw, hw, hw, -hw};
+    float dy[4] = {-hh, -hh, hh, hh};
+    if (angle != 0.0f) {
+        float a = angle * (float)M_PI / 180.0f;
+        float c = SDL_cosf(a), sn = SDL_sinf(a);
+        for (int i = 0; i < 4; i++) {
+            float rx = dx[i] * c - dy[i] * sn;
+            dy[i] = dx[i] * sn + dy[i] * c;
+            dx[i] = rx;
+        }
+    }
+
+    SDL_Vertex *v = pocadv_batch_vertices + pocadv_batch_count * 4;
+    v[0] = (SDL_Vertex){{cx + dx[0], cy + dy[0]}, tint, {u0, v0}};
+    v[1] = (SDL_Vertex){{cx + dx[1], cy + dy[1]}, tint, {u1, v0}};
+    v[2] = (SDL_Vertex){{cx + dx[2], cy + dy[2]}, tint, {u1, v1}};
+    v[3] = (SDL_Vertex){{cx + dx[3], cy + dy[3]}, tint, {u0, v1}};
+
+    pocadv_batch_sprites[pocadv_batch_count].texture = tex->texture;
+    pocadv_batch_sprites[pocadv_batch_count].index = pocadv_batch_count;
+    pocadv_batch_count++;
+
+    // Outside a batch, a sprite is a batch of one
+    if (!pocadv_batching) pocadv_batch_end();
+}
+
+static int pocadv_batch_compare(const void *a, const void *b) {
+    const PocadvBatchSprite *sa = (const PocadvBatchSprite*)a;
+    const PocadvBatchSprite *sb = (const PocadvBatchSprite*)b;
+
+    if (sa->texture != sb->texture)
+        return (uintptr_t)sa->texture < (uintptr_t)sb->texture ? -1 : 1;
+    return sa->index - sb->index;
+}
+
+void pocadv_batch_end() {
+    pocadv_batching = 0;
+    if (pocadv_batch_count == 0) return;
+
+    if (pocadv_reserve((void**)&pocadv_batch_indices, &pocadv_batch_index_capacity,
+                       pocadv_batch_count * 6, sizeof(int)) < 0) {
+        pocadv_batch_count = 0;
+        return;
+    }
+
+    // Group by texture while keeping queue order within each texture. The
+    // indices select each group's quads out of the shared vertex array.
+    qsort(pocadv_batch_sprites, pocadv_batch_count, sizeof(PocadvBatchSprite), pocadv_batch_compare);
+
+    int i = 0;
+    while (i < pocadv_batch_count) {
+        SDL_Texture *tex = pocadv_batch_sprites[i].texture;
+        int first = pocadv_batch_sprites[i].index;
+        int last = first;
+        int n = 0;
+
+        for (; i < pocadv_batch_count && pocadv_batch_sprites[i].texture == tex; i++) {
+            int base = pocadv_batch_sprites[i].index * 4;
+            int *idx = pocadv_batch_indices + n * 6;
+            idx[0] = base;     idx[1] = base + 1; idx[2] = base + 2;
+            idx[3] = base;     idx[4] = base + 2; idx[5] = base + 3;
+            if (pocadv_batch_sprites[i].index > last) last = pocadv_batch_sprites[i].index;
+            n++;
+        }
+
+        // Only pass the vertex range this group actually uses
+        for (int k = 0; k < n * 6; k++) pocadv_batch_indices[k] -= first * 4;
+        pocadv_submit_geometry(tex, pocadv_batch_vertices + first * 4, (last - first + 1) * 4,
+                               pocadv_batch_indices, n * 6);
+    }
+
+    pocadv_batch_count = 0;
+}
+
+static void pocadv_free_batch() {
+    free(pocadv_batch_sprites);
+    free(pocadv_batch_vertices);
+    free(pocadv_batch_indices);
+
+    pocadv_batch_sprites = NULL;
+    pocadv_batch_vertices = NULL;
+    pocadv_batch_indices = NULL;
+
+    pocadv_batch_count = pocadv_batch_capacity = 0;
+    pocadv_batch_vertex_capacity = pocadv_batch_index_capacity = 0;
+    pocadv_batching = 0;
+}
+
+// ----------------------- Layers ----------------------
+
+pocadv_Layer* pocadv_layer_create(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+
+    pocadv_Layer *layer = (pocadv_Layer*)calloc(1, sizeof(pocadv_Layer));
+    if (!layer || pocadv_reserve((void**)&pocadv_layers, &pocadv_layer_capacity,
+                                 pocadv_layer_count + 1, sizeof(pocadv_Layer*)) < 0) {
+        free(layer);
+        return NULL;
+    }
+
+    if (pocadv_soft) {
+        // The software backend only draws into the layer's CPU copy, so no
+        // renderer texture is made: the handle's address keys the copy
+        SDL_Texture *key = (SDL_Texture*)layer;
+        SDL_Surface *blank = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        int registered = blank && pocadv_soft_register(key, blank) == 0;
+        if (blank) SDL_FreeSurface(blank);
+        if (!registered) {
+            free(layer);
+            return NULL;
+        }
+        layer->texture.texture = key;
+        layer->texture.rect = (SDL_Rect){0, 0, width, height};
+        layer->texture.tex_w = width;
+        layer->texture.tex_h = height;
+        layer->texture.format = SDL_PIXELFORMAT_ARGB8888;
+        layer->texture.blend = SDL_BLENDMODE_BLEND;
+        layer->texture.uv = (SDL_FRect){0.0f, 0.0f, 1.0f, 1.0f};
+    } else {
+        SDL_Texture *tex = SDL_CreateTexture(pocadv_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_TARGET, width, height);
+        if (!tex) {
+            free(layer);
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        if (pocadv_texture_wrap(&layer->texture, tex) < 0) {
+            pocadv_destroy_texture(tex);
+            free(layer);
+            return NULL;
+        }
+    }
+    layer->dirty = 1;
+    pocadv_layers[pocadv_layer_count++] = layer;
+    return layer;
+}
+
+// Frees a layer's texture or CPU copy, once; the handle stays
+static void pocadv_layer_release(pocadv_Layer *layer) {
+    if (!layer->texture.texture) return;
+    if (pocadv_soft) pocadv_soft_forget(layer->texture.texture);
+    else pocadv_destroy_texture(layer->texture.texture);
+    layer->texture.texture = NULL;
+}
+
+void pocadv_layer_free(pocadv_Layer *layer) {
+    if (!layer) return;
+    if (pocadv_active_layer == layer) pocadv_layer_end(layer);
+
+    for (int i = 0; i < pocadv_layer_count; i++) {
+        if (pocadv_layers[i] == layer) {
+            pocadv_layers[i] = pocadv_layers[--pocadv_layer_count];
+            break;
+        }
+    }
+    pocadv_layer_release(layer);
+    free(layer);
+}
+
+int pocadv_layer_begin(pocadv_Layer *layer) {
+    if (!layer || !layer->texture.texture || !layer->dirty || pocadv_active_layer) return 0;
+
+    // Whatever was recorded so far belongs on the screen
+    if (pocadv_deferred) pocadv_flush();
+
+    if (pocadv_soft) {
+        PocadvSoftImage *img = pocadv_soft_image(layer->texture.texture);
+        if (!img) return 0;
+        pocadv_screen_fb = pocadv_fb;
+        pocadv_screen_fb_w = pocadv_fb_w;
+        pocadv_screen_fb_h = pocadv_fb_h;
+        pocadv_fb = img->pixels;
+        pocadv_fb_w = img->w;
+        pocadv_fb_h = img->h;
+        pocadv_fill_span(pocadv_fb, 0, pocadv_fb_w * pocadv_fb_h);
+    } else {
+        if (SDL_SetRenderTarget(pocadv_renderer, layer->texture.texture) != 0) return 0;
+        SDL_SetRenderDrawColor(pocadv_renderer, 0, 0, 0, 0);
+        SDL_RenderClear(pocadv_renderer);
+        if (!pocadv_deferred)
+            SDL_SetRenderDrawColor(pocadv_renderer, pocadv_draw_color.r, pocadv_draw_color.g,
+                                   pocadv_draw_color.b, pocadv_draw_color.a);
+    }
+
+    pocadv_active_layer = layer;
+    return 1;
+}
+
+void pocadv_layer_end(pocadv_Layer *layer) {
+    if (!layer || pocadv_active_layer != layer) return;
+
+    if (pocadv_deferred) pocadv_flush();
+
+    if (pocadv_soft) {
+        pocadv_fb = pocadv_screen_fb;
+        pocadv_fb_w = pocadv_screen_fb_w;
+        pocadv_fb_h = pocadv_screen_fb_h;
+    } else {
+        SDL_SetRenderTarget(pocadv_renderer, NULL);
+    }
+
+    layer->dirty = 0;
+    pocadv_active_layer = NULL;
+}
+
+void pocadv_layer_invalidate(pocadv_Layer *layer) {
+    if (layer) layer->dirty = 1;
+}
+
+void pocadv_layer_draw(pocadv_Layer *layer, int x, int y) {
+    if (!layer || !layer->texture.texture) return;
+    pocadv_draw_texture(&layer->texture, x, y);
+}
+
+static void pocadv_free_layers() {
+    // The handles belong to the caller, who may free them after this
+    if (pocadv_active_layer) pocadv_layer_end(pocadv_active_layer);
+    for (int i = 0; i < pocadv_layer_count; i++) pocadv_layer_release(pocadv_layers[i]);
+    free(pocadv_layers);
+    pocadv_layers = NULL;
+    pocadv_layer_count = 0;
+    pocadv_layer_capacity = 0;
+    pocadv_active_layer = NULL;
+}
+
+// ----------------------- Input ----------------------
+
+int pocadv_poll_event(SDL_Event *event) {
+    int result = SDL_PollEvent(event);
+
+    // Target textures lose their contents when the render device resets
+    if (result && event &&
+        (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET)) {
+        for (int i = 0; i < pocadv_layer_count; i++) pocadv_layers[i]->dirty = 1;
+    }
+    return result;
+}
+
+void pocadv_update_input() {
+    pocadv_prev_mouse_buttons = pocadv_curr_mouse_buttons;
+    pocadv_curr_mouse_buttons = SDL_GetMouseState(&pocadv_mouse_x, &pocadv_mouse_y);
+}
+
+int pocadv_key_down(SDL_Scancode key) {
+    if (pocadv_keyboard_state == NULL) return 0;
+    return pocadv_keyboard_state[key];
+}
+
+int pocadv_key_up(SDL_Scancode key) {
+    if (pocadv_keyboard_state == NULL) return 1;
+    return !pocadv_keyboard_state[key];
+}
+
+int pocadv_mouse_button_down(Uint8 button) {
+    return (pocadv_curr_mouse_buttons & SDL_BUTTON(button)) != 0;
+}
+
+int pocadv_mouse_button_up(Uint8 button) {
+    return (pocadv_curr_mouse_buttons & SDL_BUTTON(button)) == 0;
+}
+
+void pocadv_get_mouse_pos(int *x, int *y) {
+    if (x) *x = pocadv_mouse_x;
+    if (y) *y = pocadv_mouse_y;
+}
+
+// ----------------------- Color ----------------------
+
+// Deferred, the colour is only recorded with each draw and set on replay
+void pocadv_set_color(SDL_Color color) {
+    pocadv_draw_color = color;
+    if (!pocadv_deferred) SDL_SetRenderDrawColor(pocadv_renderer, color.r, color.g, color.b, color.a);
+}
+
+// --------------------- Primitives ----------------------
+
+void pocadv_draw_point(int x, int y) {
+    SDL_Point p = {x, y};
+    pocadv_submit_points(&p, 1);
+}
+
+void pocadv_draw_line(int x1, int y1, int x2, int y2) {
+    SDL_Point p[2] = {{x1, y1}, {x2, y2}};
+    pocadv_submit_lines(p, 2);
+}
+
+void pocadv_draw_rect(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    pocadv_submit_rects(&r, 1, 0);
+}
+
+void pocadv_draw_rect_filled(int x, int y, int w, int h) {
+    SDL_Rect r = {x, y, w, h};
+    pocadv_submit_rects(&r, 1, 1);
+}
+
+// Number of segments for a curve of the given radius, chosen so the chord
+// never strays more than a quarter pixel from the true curve
+static int pocadv_curve_segments(float radius, float sweep) {
+    if (radius < 1.0f) radius = 1.0f;
+    float step = 2.0f * (float)SDL_acos(1.0 - 0.25 / radius);
+    int segments = (int)SDL_ceilf(sweep / step);
+    segments = (segments + 3) & ~3; // keep full circles symmetric
+    if (segments < 8) segments = 8;
+    if (segments > 512) segments = 512;
+    return segments;
+}
+
+// Shared engine behind circles, ellipses and arcs. Walks the curve by
+// rotating a unit vector, so there is no trig per vertex, and submits the
+// shape as one outline strip or one triangle fan.
+static void pocadv_draw_curve(int cx, int cy, int rx, int ry, float start, float sweep, int filled) {
+    if (rx <= 0 || ry <= 0) {
+        pocadv_draw_point(cx, cy);
+        return;
+    }
+
+    const float full = 2.0f * (float)M_PI;
+    int closed = sweep >= full;
+    if (closed) sweep = full;
+
+    int segments = pocadv_curve_segments((float)(rx > ry ? rx : ry), sweep);
+    int rim = closed ? segments : segments + 1;
+
+    float step = sweep / segments;
+    float cs = SDL_cosf(step), sn = SDL_sinf(step);
+    float ux = SDL_cosf(start), uy = SDL_sinf(start);
+
+    if (!filled) {
+        int count = rim + closed;
+        if (pocadv_reserve((void**)&pocadv_shape_points, &pocadv_shape_point_capacity,
+                           count, sizeof(SDL_Point)) < 0) return;
+
+        SDL_Point *p = pocadv_shape_points;
+        int n = 0;
+        for (int i = 0; i < rim; i++) {
+            p[n].x = cx + (int)SDL_floorf(rx * ux + 0.5f);
+            p[n].y = cy + (int)SDL_floorf(ry * uy + 0.5f);
+            n++;
+            float t = ux * cs - uy * sn;
+            uy = ux * sn + uy * cs;
+            ux = t;
+        }
+        if (closed) p[n++] = p[0];
+        pocadv_submit_lines(p, n);
+        return;
+    }
+
+    // Triangle fan around the pixel centre (a pie slice for arcs); the extra
+    // half pixel matches the old midpoint fill, which covered cx - r .. cx + r
+    if (pocadv_reserve((void**)&pocadv_shape_vertices, &pocadv_shape_vertex_capacity,
+                       rim + 1, sizeof(SDL_Vertex)) < 0) return;
+    if (pocadv_reserve((void**)&pocadv_shape_indices, &pocadv_shape_index_capacity,
+                       segments * 3, sizeof(int)) < 0) return;
+
+    SDL_Vertex *v = pocadv_shape_vertices;
+    float fx = cx + 0.5f, fy = cy + 0.5f;
+    float frx = rx + 0.5f, fry = ry + 0.5f;
+
+    v[0] = (SDL_Vertex){{fx, fy}, pocadv_draw_color, {0.0f, 0.0f}};
+    for (int i = 1; i <= rim; i++) {
+        v[i] = (SDL_Vertex){{fx + frx * ux, fy + fry * uy}, pocadv_draw_color, {0.0f, 0.0f}};
+        float t = ux * cs - uy * sn;
+        uy = ux * sn + uy * cs;
+        ux = t;
+    }
+
+    int *idx = pocadv_shape_indices;
+    for (int i = 0; i < segments; i++) {
+        idx[i * 3] = 0;
+        idx[i * 3 + 1] = 1 + i;
+        idx[i * 3 + 2] = 1 + (i + 1) % rim;
+    }
+    pocadv_submit_geometry(NULL, v, rim + 1, idx, segments * 3);
+}
+
+static float pocadv_radians(float degrees) {
+    return degrees * (float)M_PI / 180.0f;
+}
+
+void pocadv_draw_circle(int cx, int cy, int radius) {
+    pocadv_draw_curve(cx, cy, radius, radius, 0.0f, 2.0f * (float)M_PI, 0);
+}
+
+void pocadv_draw_circle_filled(int cx, int cy, int radius) {
+    pocadv_draw_curve(cx, cy, radius, radius, 0.0f, 2.0f * (float)M_PI, 1);
+}
+
+void pocadv_draw_ellipse(int cx, int cy, int rx, int ry) {
+    pocadv_draw_curve(cx, cy, rx, ry, 0.0f, 2.0f * (float)M_PI, 0);
+}
+
+void pocadv_draw_ellipse_filled(int cx, int cy, int rx, int ry) {
+    pocadv_draw_curve(cx, cy, rx, ry, 0.0f, 2.0f * (float)M_PI, 1);
+}
+
+void pocadv_draw_arc(int cx, int cy, int radius, float start_deg, float end_deg) {
+    if (end_deg < start_deg) end_deg += 360.0f;
+    pocadv_draw_curve(cx, cy, radius, radius, pocadv_radians(start_deg),
+                      pocadv_radians(end_deg - start_deg), 0);
+}
+
+void pocadv_draw_arc_filled(int cx, int cy, int radius, float start_deg, float end_deg) {
+    if (end_deg < start_deg) end_deg += 360.0f;
+    pocadv_draw_curve(cx, cy, radius, radius, pocadv_radians(start_deg),
+                      pocadv_radians(end_deg - start_deg), 1);
+}
+
+void pocadv_draw_poly(const SDL_Point *points, int count) {
+    if (count < 2) return;
+    for (int i = 0; i < count - 1; i++) {
+        pocadv_draw_line(points[i].x, points[i].y,
+                         points[i + 1].x, points[i + 1].y);
+    }
+    pocadv_draw_line(points[count - 1].x, points[count - 1].y,
+                     points[0].x, points[0].y);
+}
+
+static int pocadv_compare_poly_edges(const void *a, const void *b) {
+    const PocadvPolyEdge *ea = (const PocadvPolyEdge*)a;
+    const PocadvPolyEdge *eb = (const PocadvPolyEdge*)b;
+    return (ea->y_start > eb->y_start) - (ea->y_start < eb->y_start);
+}
+
+// Scan-converts a polygon with the even-odd rule into 1-pixel-high spans
+// stored in pocadv_poly_spans. Returns the span count, or -1 on failure.
+static int pocadv_poly_scan(const SDL_Point *points, int count) {
+    if (pocadv_reserve((void**)&pocadv_poly_edges, &pocadv_poly_edge_capacity,
+                       count, sizeof(PocadvPolyEdge)) != 0 ||
+        pocadv_reserve((void**)&pocadv_poly_active, &pocadv_poly_active_capacity,
+                       count, sizeof(PocadvPolyEdge*)) != 0) {
+        return -1;
+    }
+
+    // Edge table: each non-horizontal edge covers the scanlines (top, bottom]
+    int edge_count = 0;
+    for (int i = 0; i < count; i++) {
+        const SDL_Point *p0 = &points[i];
+        const SDL_Point *p1 = &points[(i + 1) % count];
+        if (p0->y == p1->y) continue;
+        if (p0->y > p1->y) {
+            const SDL_Point *tmp = p0;
+            p0 = p1;
+            p1 = tmp;
+        }
+
+        // The step is rounded down and x biased up by 2^-16, which keeps the
+        // floored x exact for edges spanning fewer than 65536 scanlines
+        Sint64 dx = (Sint64)(p1->x - p0->x) * POCADV_POLY_ONE;
+        int dy = p1->y - p0->y;
+        PocadvPolyEdge *e = &pocadv_poly_edges[edge_count++];
+        e->y_start = p0->y + 1;
+        e->y_end = p1->y;
+        e->step = dx / dy - (dx % dy < 0);
+        e->x = (Sint64)p0->x * POCADV_POLY_ONE + e->step + (POCADV_POLY_ONE >> 16);
+    }
+    if (edge_count == 0) return 0;
+
+    qsort(pocadv_poly_edges, edge_count, sizeof(PocadvPolyEdge), pocadv_compare_poly_edges);
+
+    int span_count = 0;
+    int active_count = 0;
+    int next_edge = 0;
+    int y = pocadv_poly_edges[0].y_start;
+
+    while (next_edge < edge_count || active_count > 0) {
+        // Jump over gaps between disjoint parts of the polygon
+        if (active_count == 0 && pocadv_poly_edges[next_edge].y_start > y) {
+            y = pocadv_poly_edges[next_edge].y_start;
+        }
+
+        while (next_edge < edge_count && pocadv_poly_edges[next_edge].y_start == y) {
+            pocadv_poly_active[active_count++] = &pocadv_poly_edges[next_edge++];
+        }
+
+        // Crossings move little between scanlines, so insertion sort is near linear
+        for (int i = 1; i < active_count; i++) {
+            PocadvPolyEdge *e = pocadv_poly_active[i];
+            int j = i - 1;
+            while (j >= 0 && pocadv_poly_active[j]->x > e->x) {
+                pocadv_poly_active[j + 1] = pocadv_poly_active[j];
+                j--;
+            }
+            pocadv_poly_active[j + 1] = e;
+        }
+
+        if (pocadv_reserve((void**)&pocadv_poly_spans, &pocadv_poly_span_capacity,
+                           span_count + active_count / 2, sizeof(SDL_Rect)) != 0) {
+            return -1;
+        }
+        for (int i = 0; i + 1 < active_count; i += 2) {
+            int x0 = (int)(pocadv_poly_active[i]->x >> 32);
+            int x1 = (int)(pocadv_poly_active[i + 1]->x >> 32);
+            pocadv_poly_spans[span_count++] = (SDL_Rect){x0, y, x1 - x0 + 1, 1};
+        }
+
+        // Retire edges that end on this scanline and step the rest
+        int kept = 0;
+        for (int i = 0; i < active_count; i++) {
+            PocadvPolyEdge *e = pocadv_poly_active[i];
+            if (e->y_end == y) continue;
+            e->x += e->step;
+            pocadv_poly_active[kept++] = e;
+        }
+        active_count = kept;
+        y++;
+    }
+
+    return span_count;
+}
+
+void pocadv_draw_poly_filled(const SDL_Point *points, int count) {
+    if (count < 3) return;
+
+    int span_count = pocadv_poly_scan(points, count);
+    if (span_count > 0) pocadv_submit_rects(pocadv_poly_spans, span_count, 1);
+}
+
+// ----------------------- Timing ----------------------
+
+float pocadv_get_delta_time() {
+    Uint64 current_counter = SDL_GetPerformanceCounter();
+    Uint64 counter_diff = current_counter - pocadv_last_counter;
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    pocadv_delta_time = (float)counter_diff / (float)freq;
+    pocadv_last_counter = current_counter;
+    return pocadv_delta_time;
+}
+
+
+// ----------------------- Audio decoding ----------------------
+
+static Uint32 pocadv_read_le32(const Uint8 *p) {
+    return (Uint32)p[0] | ((Uint32)p[1] << 8) | ((Uint32)p[2] << 16) | ((Uint32)p[3] << 24);
+}
+
+static Uint16 pocadv_read_le16(const Uint8 *p) {
+    return (Uint16)(p[0] | (p[1] << 8));
+}
+
+static void pocadv_write_le32(Uint8 *p, Uint32 v) {
+    p[0] = (Uint8)v;
+    p[1] = (Uint8)(v >> 8);
+    p[2] = (Uint8)(v >> 16);
+    p[3] = (Uint8)(v >> 24);
+}
+
+static void pocadv_write_le16(Uint8 *p, Uint16 v) {
+    p[0] = (Uint8)v;
+    p[1] = (Uint8)(v >> 8);
+}
+
+// IMA ADPCM, in the block layout WAV files use: every channel's first
+// sample and step index, then groups of 4 bytes per channel holding 8
+// samples each, low nibble first. Each sample costs 4 bits.
+#define POCADV_ADPCM_BLOCK 256        // bytes per channel in the blocks sounds are encoded into
+#define POCADV_ADPCM_MAX_FRAMES 2041  // the longest blocks taken from files, 1024 bytes per channel
+
+static const Sint16 pocadv_ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88,
+    97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660,
+    4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818,
+    18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const Sint8 pocadv_ima_index_steps[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static int pocadv_ima_block_frames(int block_size, int channels) {
+    return (block_size - 4 * channels) * 2 / channels + 1;
+}
+
+// The signed change one 4-bit code makes to the predictor at a step index
+static int pocadv_ima_diff(int code, int index) {
+    int step = pocadv_ima_steps[index];
+    int diff = step >> 3;
+    if (code & 4) diff += step;
+    if (code & 2) diff += step >> 1;
+    if (code & 1) diff += step >> 2;
+    return code & 8 ? -diff : diff;
+}
+
+// Applies one 4-bit code to a channel's predictor and step index
+static Sint16 pocadv_ima_apply(int code, int *predictor, int *index) {
+    int p = *predictor + pocadv_ima_diff(code, *index);
+    *predictor = p < -32768 ? -32768 : p > 32767 ? 32767 : p;
+    int i = *index + pocadv_ima_index_steps[code];
+    *index = i < 0 ? 0 : i > 88 ? 88 : i;
+    return (Sint16)*predictor;
+}
+
+// pocadv_ima_apply for every step index and code, so the decoder does one
+// lookup per sample and no branches; filled in when the device opens
+typedef struct {
+    Sint32 diff;
+    Sint32 next;                  // step index of the next sample, times 16
+} PocadvImaStep;
+
+static PocadvImaStep pocadv_ima_table[89 * 16];
+
+static void pocadv_ima_init() {
+    for (int index = 0; index < 89; index++) {
+        for (int code = 0; code < 16; code++) {
+            // Unclamped: only the running predictor is held to 16 bits
+            int next = index + pocadv_ima_index_steps[code];
+            next = next < 0 ? 0 : next > 88 ? 88 : next;
+            pocadv_ima_table[index * 16 + code].diff = pocadv_ima_diff(code, index);
+            pocadv_ima_table[index * 16 + code].next = next * 16;
+        }
+    }
+}
+
+// Decodes a block from where `st` is up to at least frame `frames`, in
+// whole groups, writing each frame at its place in the block. `st` is left
+// at the start of the group `frames` falls in, so the next call picks up
+// there. Each channel is one serial chain; channels are decoded in pairs so
+// two chains overlap.
+static void pocadv_ima_decode(const Uint8 *block, int channels, int frames, pocadv_ImaState *st, Sint16 *out) {
+    if (st->frame == 0) {
+        for (int c = 0; c < channels; c++) {
+            st->predictor[c] = (Sint16)pocadv_read_le16(block + 4 * c);
+            st->state[c] = (block[4 * c + 2] > 88 ? 88 : block[4 * c + 2]) * 16;
+            out[c] = (Sint16)st->predictor[c];
+        }
+        st->frame = 1;
+    }
+    int first = st->frame, last = first + (frames - first) / 8 * 8;
+
+    for (int c = 0; c < channels; c += 2) {
+        int d = c + 1 < channels ? c + 1 : c; // an odd last channel pairs with itself
+        int predictor0 = st->predictor[c], predictor1 = st->predictor[d];
+        int state0 = st->state[c], state1 = st->state[d];
+
+        const Uint8 *p0 = block + 4 * channels + (first - 1) / 2 * channels + 4 * c;
+        const Uint8 *p1 = block + 4 * channels + (first - 1) / 2 * channels + 4 * d;
+        Sint16 *o0 = out + first * channels + c, *o1 = out + first * channels + d;
+        for (int frame = first;; frame += 8, p0 += 4 * channels, p1 += 4 * channels) {
+            if (frame == last) {
+                st->predictor[c] = predictor0;
+                st->predictor[d] = predictor1;
+                st->state[c] = state0;
+                st->state[d] = state1;
+            }
+            if (frame >= frames) break;
+            for (int k = 0; k < 8; k++, o0 += channels, o1 += channels) {
+                const PocadvImaStep *e0 = &pocadv_ima_table[state0 + (p0[k >> 1] >> (k & 1) * 4 & 15)];
+                const PocadvImaStep *e1 = &pocadv_ima_table[state1 + (p1[k >> 1] >> (k & 1) * 4 & 15)];
+                predictor0 += e0->diff;
+                predictor1 += e1->diff;
+                predictor0 = predictor0 < -32768 ? -32768 : predictor0 > 32767 ? 32767 : predictor0;
+                predictor1 = predictor1 < -32768 ? -32768 : predictor1 > 32767 ? 32767 : predictor1;
+                state0 = e0->next;
+                state1 = e1->next;
+                *o0 = (Sint16)predictor0;
+                *o1 = (Sint16)predictor1;
+            }
+        }
+    }
+    st->frame = last;
+}
+
+// Picks the code that lands the predictor closest to `sample`
+static int pocadv_ima_code(int sample, int *predictor, int *index) {
+    int step = pocadv_ima_steps[*index];
+    int diff = sample - *predictor, code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+    }
+    if (diff >= step >> 1) {
+        code |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= step >> 2) code |= 1;
+
+    pocadv_ima_apply(code, predictor, index);
+    return code;
+}
+
+// Encodes interleaved samples into blocks of POCADV_ADPCM_BLOCK bytes per
+// channel, the last one padded with silence. Returns an SDL_malloc'd buffer.
+static Uint8* pocadv_ima_encode(const Sint16 *samples, Uint32 frames, int channels, Uint32 *size) {
+    int block_size = POCADV_ADPCM_BLOCK * channels;
+    int block_frames = pocadv_ima_block_frames(block_size, channels);
+    Uint32 blocks = (frames + (Uint32)block_frames - 1) / (Uint32)block_frames;
+    Uint8 *data = (Uint8*)SDL_malloc((size_t)blocks * block_size);
+    if (!data) return NULL;
+
+    int index[POCADV_MAX_CHANNELS] = {0};
+    for (Uint32 b = 0; b < blocks; b++) {
+        Uint8 *block = data + (size_t)b * block_size;
+        Uint32 first = b * (Uint32)block_frames;
+        int predictor[POCADV_MAX_CHANNELS];
+        for (int c = 0; c < channels; c++) {
+            predictor[c] = samples[(size_t)first * channels + c];
+            pocadv_write_le16(block + 4 * c, (Uint16)predictor[c]);
+            block[4 * c + 2] = (Uint8)index[c];
+            block[4 * c + 3] = 0;
+        }
+
+        Uint8 *p = block + 4 * channels;
+        for (Uint32 frame = first + 1; frame < first + (Uint32)block_frames; frame += 8, p += 4 * channels) {
+            for (int c = 0; c < channels; c++) {
+                for (int k = 0; k < 8; k++) {
+                    Uint32 f = frame + (Uint32)k;
+                    int sample = f < frames ? samples[(size_t)f * channels + c] : 0;
+                    int code = pocadv_ima_code(sample, &predictor[c], &index[c]);
+                    if (k & 1) p[4 * c + k / 2] |= (Uint8)(code << 4);
+                    else p[4 * c + k / 2] = (Uint8)code;
+                }
+            }
+        }
+    }
+    *size = blocks * (Uint32)block_size;
+    return data;
+}
+
+// Reads a WAV header of uncompressed or IMA ADPCM samples, leaving `file`
+// at the start of the data chunk. `length` (may be NULL) gets the frame
+// count from a fact chunk ahead of the data, or 0 without one.
+static int pocadv_wav_open(SDL_RWops *file, SDL_AudioSpec *spec, Sint64 *data_start, Sint64 *data_size,
+                           int *frame_size, Uint32 *length) {
+    if (length) *length = 0;
+    Uint8 header[12];
+    if (SDL_RWread(file, header, 1, 12) != 12 ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) return -1;
+
+    int have_format = 0;
+    for (;;) {
+        Uint8 chunk[8];
+        if (SDL_RWread(file, chunk, 1, 8) != 8) return -1;
+        Uint32 size = pocadv_read_le32(chunk + 4);
+
+        if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) return -1;
+            *data_start = SDL_RWtell(file);
+            *data_size = size;
+
+            // Some writers leave the size unset when streaming to disk
+            Sint64 file_size = SDL_RWsize(file);
+            if (file_size >= 0 && *data_start + *data_size > file_size) *data_size = file_size - *data_start;
+            *data_size -= *data_size % *frame_size;
+            return 0;
+        }
+
+        Sint64 skip = size + (size & 1); // chunks are padded to even sizes
+        if (memcmp(chunk, "fact", 4) == 0 && size >= 4) {
+            // Compressed formats give their real length here; the last
+            // block is padded past it
+            Uint8 fact[4];
+            if (SDL_RWread(file, fact, 1, 4) != 4) return -1;
+            skip -= 4;
+            if (length) *length = pocadv_read_le32(fact);
+        } else if (memcmp(chunk, "fmt ", 4) == 0) {
+            Uint8 fmt[40] = {0};
+            Uint32 n = size < sizeof(fmt) ? size : (Uint32)sizeof(fmt);
+            if (size < 16 || SDL_RWread(file, fmt, 1, n) != n) return -1;
+            skip -= n;
+
+            Uint16 tag = pocadv_read_le16(fmt);
+            if (tag == 0xFFFE && size >= 26) tag = pocadv_read_le16(fmt + 24); // WAVE_FORMAT_EXTENSIBLE
+            int bits = pocadv_read_le16(fmt + 14);
+
+            SDL_zerop(spec);
+            spec->channels = (Uint8)pocadv_read_le16(fmt + 2);
+            spec->freq = (int)pocadv_read_le32(fmt + 4);
+            if (spec->channels == 0 || spec->freq <= 0) return -1;
+
+            // IMA ADPCM has no SDL format: it is reported as format 0, with
+            // the block as the frame and spec->samples the frames per block
+            int block_size = pocadv_read_le16(fmt + 12);
+            if (tag == 0x11 && bits == 4 && block_size > 4 * spec->channels &&
+                block_size % (4 * spec->channels) == 0) {
+                *frame_size = block_size;
+                spec->samples = (Uint16)pocadv_ima_block_frames(block_size, spec->channels);
+                have_format = 1;
+            } else {
+                if (tag == 1 && bits == 8) spec->format = AUDIO_U8;
+                else if (tag == 1 && bits == 16) spec->format = AUDIO_S16LSB;
+                else if (tag == 1 && bits == 32) spec->format = AUDIO_S32LSB;
+                else if (tag == 3 && bits == 32) spec->format = AUDIO_F32LSB;
+                else return -1;
+
+                *frame_size = spec->channels * bits / 8;
+                have_format = 1;
+            }
+        }
+        if (SDL_RWseek(file, skip, RW_SEEK_CUR) < 0) return -1;
+    }
+}
+
+// MP3: MPEG-1 Layer III, decoded in floating point. MPEG-2/2.5 half-rate
+// streams and free-format bitrates are rejected.
+
+#define POCADV_MP3_MAX_FRAME 1441      // 320 kbps at 32 kHz, padded
+#define POCADV_MP3_RESERVOIR 511       // main data a frame may borrow from earlier ones
+#define POCADV_MP3_INDEX_STEP 32       // frames between seek index entries
+#define POCADV_MP3_SEEK_PRIME 12       // frames decoded and dropped before a seek target
+#define POCADV_MP3_DECODER_DELAY 529   // samples the synthesis filter bank adds in front
+
+typedef struct {
+    int freq, channels, sr_index;
+    int mode, mode_ext, crc;
+    int bytes;                    // the whole frame, header included
+} PocadvMp3Header;
+
+// Side info for one channel of one granule
+typedef struct {
+    int part2_3_length, big_values, global_gain, scalefac_compress;
+    int block_type, mixed_block;  // block_type 0 unless window switching is on
+    int table_select[3], subblock_gain[3];
+    int region0_count, region1_count;
+    int preflag, scalefac_scale, count1_table;
+} PocadvMp3Channel;
+
+typedef struct {
+    int l[22];                    // long blocks, per scalefactor band
+    int s[13][3];                 // short blocks, per band and window
+} PocadvMp3Scalefac;
+
+typedef struct PocadvMp3 {
+    SDL_RWops *file;              // not owned
+    int freq, channels;
+    Sint64 first_frame;           // offset of the first frame with audio
+    Uint64 skip;                  // encoder and decoder delay, dropped from the start
+    Uint64 length;                // samples in the track, 0 if the file doesn't say
+
+    Sint64 *index;                // offset of every POCADV_MP3_INDEX_STEP-th frame
+    int index_count, index_capacity;
+    Sint64 offset;                // of the next frame
+    Sint64 file_pos;              // where `file` is, to skip needless seeks
+    int frame;                    // number of the next frame
+
+    Sint16 pcm[1152 * 2];         // the last decoded frame, interleaved
+    int pcm_pos;                  // next sample frame of it to hand out
+    Uint64 pcm_start;             // track position of pcm[0]
+    Uint64 want;                  // output starts at this position
+
+    // Decoder state carried from frame to frame
+    Uint8 main_data[POCADV_MP3_RESERVOIR + POCADV_MP3_MAX_FRAME];
+    int main_data_len;
+    PocadvMp3Scalefac scalefac[2];
+    float overlap[2][576];
+    float synth[2][1024];
+    int synth_pos[2];
+} PocadvMp3;
+
+typedef struct {
+    const Uint8 *data;
+    int pos, end;                 // in bits; reads past the end give zeros
+} PocadvBits;
+
+typedef struct {
+    const Uint16 *codes;
+    const Uint8 *lens;
+    int count, dim;               // dim is values per row of (x, y) pairs
+    Sint16 *tree;                 // built from the codes on first use
+} PocadvMp3Table;
+
+static const int pocadv_mp3_bitrates[15] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+static const int pocadv_mp3_freqs[3] = {44100, 48000, 32000};
+
+static const Uint16 pocadv_mp3_long_bands[3][23] = {
+    {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 52, 62, 74, 90, 110, 134, 162, 196, 238, 288, 342, 418, 576},
+    {0, 4, 8, 12, 16, 20, 24, 30, 36, 42, 50, 60, 72, 88, 106, 128, 156, 190, 230, 276, 330, 384, 576},
+    {0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 54, 66, 82, 102, 126, 156, 194, 240, 296, 364, 448, 550, 576},
+};
+
+static const Uint16 pocadv_mp3_short_bands[3][14] = {
+    {0, 4, 8, 12, 16, 22, 30, 40, 52, 66, 84, 106, 136, 192},
+    {0, 4, 8, 12, 16, 22, 28, 38, 50, 64, 80, 100, 126, 192},
+    {0, 4, 8, 12, 16, 22, 30, 42, 58, 78, 104, 138, 180, 192},
+};
+
+static const Uint8 pocadv_mp3_slen[16][2] = {
+    {0, 0}, {0, 1}, {0, 2}, {0, 3}, {3, 0}, {1, 1}, {1, 2}, {1, 3},
+    {2, 1}, {2, 2}, {2, 3}, {3, 1}, {3, 2}, {3, 3}, {4, 2}, {4, 3},
+};
+
+static const Uint8 pocadv_mp3_pretab[22] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0};
+
+static const Uint8 pocadv_mp3_linbits[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 2, 3, 4, 6, 8, 10, 13, 4, 5, 6, 7, 8, 9, 11, 13,
+};
+
+static const float pocadv_mp3_alias_coefs[8] = {-0.6f, -0.535f, -0.33f, -0.185f, -0.095f, -0.041f, -0.0142f, -0.0037f};
+
+// First half of the synthesis window, in units of 2^-16 and without the
+// sign flips of the standard's D[] table
+static const Sint32 pocadv_mp3_window_base[257] = {
+    0, -1, -1, -1, -1, -1, -1, -2, -2, -2, -2, -3,
+    -3, -4, -4, -5, -5, -6, -7, -7, -8, -9, -10, -11,
+    -13, -14, -16, -17, -19, -21, -24, -26, -29, -31, -35, -38,
+    -41, -45, -49, -53, -58, -63, -68, -73, -79, -85, -91, -97,
+    -104, -111, -117, -125, -132, -139, -147, -154, -161, -169, -176, -183,
+    -190, -196, -202, -208, -213, -218, -222, -225, -227, -228, -228, -227,
+    -224, -221, -215, -208, -200, -189, -177, -163, -146, -127, -106, -83,
+    -57, -29, 2, 36, 72, 111, 153, 197, 244, 294, 347, 401,
+    459, 519, 581, 645, 711, 779, 848, 919, 991, 1064, 1137, 1210,
+    1283, 1356, 1428, 1498, 1567, 1634, 1698, 1759, 1817, 1870, 1919, 1962,
+    2001, 2032, 2057, 2075, 2085, 2087, 2080, 2063, 2037, 2000, 1952, 1893,
+    1822, 1739, 1644, 1535, 1414, 1280, 1131, 970, 794, 605, 402, 185,
+    -45, -288, -545, -814, -1095, -1388, -1692, -2006, -2330, -2663, -3004, -3351,
+    -3705, -4063, -4425, -4788, -5153, -5517, -5879, -6237, -6589, -6935, -7271, -7597,
+    -7910, -8209, -8491, -8755, -8998, -9219, -9416, -9585, -9727, -9838, -9916, -9959,
+    -9966, -9935, -9863, -9750, -9592, -9389, -9139, -8840, -8492, -8092, -7640, -7134,
+    -6574, -5959, -5288, -4561, -3776, -2935, -2037, -1082, -70, 998, 2122, 3300,
+    4533, 5818, 7154, 8540, 9975, 11455, 12980, 14548, 16155, 17799, 19478, 21189,
+    22929, 24694, 26482, 28289, 30112, 31947, 33791, 35640, 37489, 39336, 41176, 43006,
+    44821, 46617, 48390, 50137, 51853, 53534, 55178, 56778, 58333, 59838, 61289, 62684,
+    64019, 65290, 66494, 67629, 68692, 69679, 70590, 71420, 72169, 72835, 73415, 73908,
+    74313, 74630, 74856, 74992, 75038,
+};
+
+// Big-values tables: codes and their lengths, rows of x by columns of y
+static const Uint16 pocadv_mp3_codes1[] = {
+    1,1,
+    1,0,
+};
+static const Uint8 pocadv_mp3_lens1[] = {
+    1,3,
+    2,3,
+};
+static const Uint16 pocadv_mp3_codes2[] = {
+    1,2,1,
+    3,1,1,
+    3,2,0,
+};
+static const Uint8 pocadv_mp3_lens2[] = {
+    1,3,6,
+    3,3,5,
+    5,5,6,
+};
+static const Uint16 pocadv_mp3_codes3[] = {
+    3,2,1,
+    1,1,1,
+    3,2,0,
+};
+static const Uint8 pocadv_mp3_lens3[] = {
+    2,2,6,
+    3,2,5,
+    5,5,6,
+};
+static const Uint16 pocadv_mp3_codes5[] = {
+    1,2,6,5,
+    3,1,4,4,
+    7,5,7,1,
+    6,1,1,0,
+};
+static const Uint8 pocadv_mp3_lens5[] = {
+    1,3,6,7,
+    3,3,6,7,
+    6,6,7,8,
+    7,6,7,8,
+};
+static const Uint16 pocadv_mp3_codes6[] = {
+    7,3,5,1,
+    6,2,3,2,
+    5,4,4,1,
+    3,3,2,0,
+};
+static const Uint8 pocadv_mp3_lens6[] = {
+    3,3,5,7,
+    3,2,4,5,
+    4,4,5,6,
+    6,5,6,7,
+};
+static const Uint16 pocadv_mp3_codes7[] = {
+    1,2,10,19,16,10,
+    3,3,7,10,5,3,
+    11,4,13,17,8,4,
+    12,11,18,15,11,2,
+    7,6,9,14,3,1,
+    6,4,5,3,2,0,
+};
+static const Uint8 pocadv_mp3_lens7[] = {
+    1,3,6,8,8,9,
+    3,4,6,7,7,8,
+    6,5,7,8,8,9,
+    7,7,8,9,9,9,
+    7,7,8,9,9,10,
+    8,8,9,10,10,10,
+};
+static const Uint16 pocadv_mp3_codes8[] = {
+    3,4,6,18,12,5,
+    5,1,2,16,9,3,
+    7,3,5,14,7,3,
+    19,17,15,13,10,4,
+    13,5,8,11,5,1,
+    12,4,4,1,1,0,
+};
+static const Uint8 pocadv_mp3_lens8[] = {
+    2,3,6,8,8,9,
+    3,2,4,8,8,8,
+    6,4,6,8,8,9,
+    8,8,8,9,9,10,
+    8,7,8,9,10,10,
+    9,8,9,9,11,11,
+};
+static const Uint16 pocadv_mp3_codes9[] = {
+    7,5,9,14,15,7,
+    6,4,5,5,6,7,
+    7,6,8,8,8,5,
+    15,6,9,10,5,1,
+    11,7,9,6,4,1,
+    14,4,6,2,6,0,
+};
+static const Uint8 pocadv_mp3_lens9[] = {
+    3,3,5,6,8,9,
+    3,3,4,5,6,8,
+    4,4,5,6,7,8,
+    6,5,6,7,7,8,
+    7,6,7,7,8,9,
+    8,7,8,8,9,9,
+};
+static const Uint16 pocadv_mp3_codes10[] = {
+    1,2,10,23,35,30,12,17,
+    3,3,8,12,18,21,12,7,
+    11,9,15,21,32,40,19,6,
+    14,13,22,34,46,23,18,7,
+    20,19,33,47,27,22,9,3,
+    31,22,41,26,21,20,5,3,
+    14,13,10,11,16,6,5,1,
+    9,8,7,8,4,4,2,0,
+};
+static const Uint8 pocadv_mp3_lens10[] = {
+    1,3,6,8,9,9,9,10,
+    3,4,6,7,8,9,8,8,
+    6,6,7,8,9,10,9,9,
+    7,7,8,9,10,10,9,10,
+    8,8,9,10,10,10,10,10,
+    9,9,10,10,11,11,10,11,
+    8,8,9,10,10,10,11,11,
+    9,8,9,10,10,11,11,11,
+};
+static const Uint16 pocadv_mp3_codes11[] = {
+    3,4,10,24,34,33,21,15,
+    5,3,4,10,32,17,11,10,
+    11,7,13,18,30,31,20,5,
+    25,11,19,59,27,18,12,5,
+    35,33,31,58,30,16,7,5,
+    28,26,32,19,17,15,8,14,
+    14,12,9,13,14,9,4,1,
+    11,4,6,6,6,3,2,0,
+};
+static const Uint8 pocadv_mp3_lens11[] = {
+    2,3,5,7,8,9,8,9,
+    3,3,4,6,8,8,7,8,
+    5,5,6,7,8,9,8,8,
+    7,6,7,9,8,10,8,9,
+    8,8,8,9,9,10,9,10,
+    8,8,9,10,10,11,10,11,
+    8,7,7,8,9,10,10,10,
+    8,7,8,9,10,10,10,10,
+};
+static const Uint16 pocadv_mp3_codes12[] = {
+    9,6,16,33,41,39,38,26,
+    7,5,6,9,23,16,26,11,
+    17,7,11,14,21,30,10,7,
+    17,10,15,12,18,28,14,5,
+    32,13,22,19,18,16,9,5,
+    40,17,31,29,17,13,4,2,
+    27,12,11,15,10,7,4,1,
+    27,12,8,12,6,3,1,0,
+};
+static const Uint8 pocadv_mp3_lens12[] = {
+    4,3,5,7,8,9,9,9,
+    3,3,4,5,7,7,8,8,
+    5,4,5,6,7,8,7,8,
+    6,5,6,6,7,8,8,8,
+    7,6,7,7,8,8,8,9,
+    8,7,8,8,8,9,8,9,
+    8,7,7,8,8,9,9,10,
+    9,8,8,9,9,9,9,10,
+};
+static const Uint16 pocadv_mp3_codes13[] = {
+    1,5,14,21,34,51,46,71,42,52,68,52,67,44,43,19,
+    3,4,12,19,31,26,44,33,31,24,32,24,31,35,22,14,
+    15,13,23,36,59,49,77,65,29,40,30,40,27,33,42,16,
+    22,20,37,61,56,79,73,64,43,76,56,37,26,31,25,14,
+    35,16,60,57,97,75,114,91,54,73,55,41,48,53,23,24,
+    58,27,50,96,76,70,93,84,77,58,79,29,74,49,41,17,
+    47,45,78,74,115,94,90,79,69,83,71,50,59,38,36,15,
+    72,34,56,95,92,85,91,90,86,73,77,65,51,44,43,42,
+    43,20,30,44,55,78,72,87,78,61,46,54,37,30,20,16,
+    53,25,41,37,44,59,54,81,66,76,57,54,37,18,39,11,
+    35,33,31,57,42,82,72,80,47,58,55,21,22,26,38,22,
+    53,25,23,38,70,60,51,36,55,26,34,23,27,14,9,7,
+    34,32,28,39,49,75,30,52,48,40,52,28,18,17,9,5,
+    45,21,34,64,56,50,49,45,31,19,12,15,10,7,6,3,
+    48,23,20,39,36,35,53,21,16,23,13,10,6,1,4,2,
+    16,15,17,27,25,20,29,11,17,12,16,8,1,1,0,1,
+};
+static const Uint8 pocadv_mp3_lens13[] = {
+    1,4,6,7,8,9,9,10,9,10,11,11,12,12,13,13,
+    3,4,6,7,8,8,9,9,9,9,10,10,11,12,12,12,
+    6,6,7,8,9,9,10,10,9,10,10,11,11,12,13,13,
+    7,7,8,9,9,10,10,10,10,11,11,11,11,12,13,13,
+    8,7,9,9,10,10,11,11,10,11,11,12,12,13,13,14,
+    9,8,9,10,10,10,11,11,11,11,12,11,13,13,14,14,
+    9,9,10,10,11,11,11,11,11,12,12,12,13,13,14,14,
+    10,9,10,11,11,11,12,12,12,12,13,13,13,14,16,16,
+    9,8,9,10,10,11,11,12,12,12,12,13,13,14,15,15,
+    10,9,10,10,11,11,11,13,12,13,13,14,14,14,16,15,
+    10,10,10,11,11,12,12,13,12,13,14,13,14,15,16,17,
+    11,10,10,11,12,12,12,12,13,13,13,14,15,15,15,16,
+    11,11,11,12,12,13,12,13,14,14,15,15,15,16,16,16,
+    12,11,12,13,13,13,14,14,14,14,14,15,16,15,16,16,
+    13,12,12,13,13,13,15,14,14,17,15,15,15,17,16,16,
+    12,12,13,14,14,14,15,14,15,15,16,16,19,18,19,16,
+};
+static const Uint16 pocadv_mp3_codes15[] = {
+    7,12,18,53,47,76,124,108,89,123,108,119,107,81,122,63,
+    13,5,16,27,46,36,61,51,42,70,52,83,65,41,59,36,
+    19,17,15,24,41,34,59,48,40,64,50,78,62,80,56,33,
+    29,28,25,43,39,63,55,93,76,59,93,72,54,75,50,29,
+    52,22,42,40,67,57,95,79,72,57,89,69,49,66,46,27,
+    77,37,35,66,58,52,91,74,62,48,79,63,90,62,40,38,
+    125,32,60,56,50,92,78,65,55,87,71,51,73,51,70,30,
+    109,53,49,94,88,75,66,122,91,73,56,42,64,44,21,25,
+    90,43,41,77,73,63,56,92,77,66,47,67,48,53,36,20,
+    71,34,67,60,58,49,88,76,67,106,71,54,38,39,23,15,
+    109,53,51,47,90,82,58,57,48,72,57,41,23,27,62,9,
+    86,42,40,37,70,64,52,43,70,55,42,25,29,18,11,11,
+    118,68,30,55,50,46,74,65,49,39,24,16,22,13,14,7,
+    91,44,39,38,34,63,52,45,31,52,28,19,14,8,9,3,
+    123,60,58,53,47,43,32,22,37,24,17,12,15,10,2,1,
+    71,37,34,30,28,20,17,26,21,16,10,6,8,6,2,0,
+};
+static const Uint8 pocadv_mp3_lens15[] = {
+    3,4,5,7,7,8,9,9,9,10,10,11,11,11,12,13,
+    4,3,5,6,7,7,8,8,8,9,9,10,10,10,11,11,
+    5,5,5,6,7,7,8,8,8,9,9,10,10,11,11,11,
+    6,6,6,7,7,8,8,9,9,9,10,10,10,11,11,11,
+    7,6,7,7,8,8,9,9,9,9,10,10,10,11,11,11,
+    8,7,7,8,8,8,9,9,9,9,10,10,11,11,11,12,
+    9,7,8,8,8,9,9,9,9,10,10,10,11,11,12,12,
+    9,8,8,9,9,9,9,10,10,10,10,10,11,11,11,12,
+    9,8,8,9,9,9,9,10,10,10,10,11,11,12,12,12,
+    9,8,9,9,9,9,10,10,10,11,11,11,11,12,12,12,
+    10,9,9,9,10,10,10,10,10,11,11,11,11,12,13,12,
+    10,9,9,9,10,10,10,10,11,11,11,11,12,12,12,13,
+    11,10,9,10,10,10,11,11,11,11,11,11,12,12,13,13,
+    11,10,10,10,10,11,11,11,11,12,12,12,12,12,13,13,
+    12,11,11,11,11,11,11,11,12,12,12,12,13,13,12,13,
+    12,11,11,11,11,11,11,12,12,12,12,12,13,13,13,13,
+};
+static const Uint16 pocadv_mp3_codes16[] = {
+    1,5,14,44,74,63,110,93,172,149,138,242,225,195,376,17,
+    3,4,12,20,35,62,53,47,83,75,68,119,201,107,207,9,
+    15,13,23,38,67,58,103,90,161,72,127,117,110,209,206,16,
+    45,21,39,69,64,114,99,87,158,140,252,212,199,387,365,26,
+    75,36,68,65,115,101,179,164,155,264,246,226,395,382,362,9,
+    66,30,59,56,102,185,173,265,142,253,232,400,388,378,445,16,
+    111,54,52,100,184,178,160,133,257,244,228,217,385,366,715,10,
+    98,48,91,88,165,157,148,261,248,407,397,372,380,889,884,8,
+    85,84,81,159,156,143,260,249,427,401,392,383,727,713,708,7,
+    154,76,73,141,131,256,245,426,406,394,384,735,359,710,352,11,
+    139,129,67,125,247,233,229,219,393,743,737,720,885,882,439,4,
+    243,120,118,115,227,223,396,746,742,736,721,712,706,223,436,6,
+    202,224,222,218,216,389,386,381,364,888,443,707,440,437,1728,4,
+    747,211,210,208,370,379,734,723,714,1735,883,877,876,3459,865,2,
+    377,369,102,187,726,722,358,711,709,866,1734,871,3458,870,434,0,
+    12,10,7,11,10,17,11,9,13,12,10,7,5,3,1,3,
+};
+static const Uint8 pocadv_mp3_lens16[] = {
+    1,4,6,8,9,9,10,10,11,11,11,12,12,12,13,9,
+    3,4,6,7,8,9,9,9,10,10,10,11,12,11,12,8,
+    6,6,7,8,9,9,10,10,11,10,11,11,11,12,12,9,
+    8,7,8,9,9,10,10,10,11,11,12,12,12,13,13,10,
+    9,8,9,9,10,10,11,11,11,12,12,12,13,13,13,9,
+    9,8,9,9,10,11,11,12,11,12,12,13,13,13,14,10,
+    10,9,9,10,11,11,11,11,12,12,12,12,13,13,14,10,
+    10,9,10,10,11,11,11,12,12,13,13,13,13,15,15,10,
+    10,10,10,11,11,11,12,12,13,13,13,13,14,14,14,10,
+    11,10,10,11,11,12,12,13,13,13,13,14,13,14,13,11,
+    11,11,10,11,12,12,12,12,13,14,14,14,15,15,14,10,
+    12,11,11,11,12,12,13,14,14,14,14,14,14,13,14,11,
+    12,12,12,12,12,13,13,13,13,15,14,14,14,14,16,11,
+    14,12,12,12,13,13,14,14,14,16,15,15,15,17,15,11,
+    13,13,11,12,14,14,13,14,14,15,16,15,17,15,14,11,
+    9,8,8,9,9,10,10,10,11,11,11,11,11,11,11,8,
+};
+static const Uint16 pocadv_mp3_codes24[] = {
+    15,13,46,80,146,262,248,434,426,669,653,649,621,517,1032,88,
+    14,12,21,38,71,130,122,216,209,198,327,345,319,297,279,42,
+    47,22,41,74,68,128,120,221,207,194,182,340,315,295,541,18,
+    81,39,75,70,134,125,116,220,204,190,178,325,311,293,271,16,
+    147,72,69,135,127,118,112,210,200,188,352,323,306,285,540,14,
+    263,66,129,126,119,114,214,202,192,180,341,317,301,281,262,12,
+    249,123,121,117,113,215,206,195,185,347,330,308,291,272,520,10,
+    435,115,111,109,211,203,196,187,353,332,313,298,283,531,381,17,
+    427,212,208,205,201,193,186,177,169,320,303,286,268,514,377,16,
+    335,199,197,191,189,181,174,333,321,305,289,275,521,379,371,11,
+    668,184,183,179,175,344,331,314,304,290,277,530,383,373,366,10,
+    652,346,171,168,164,318,309,299,287,276,263,513,375,368,362,6,
+    648,322,316,312,307,302,292,284,269,261,512,376,370,364,359,4,
+    620,300,296,294,288,282,273,266,515,380,374,369,365,361,357,2,
+    1033,280,278,274,267,264,259,382,378,372,367,363,360,358,356,0,
+    43,20,19,17,15,13,11,9,7,6,4,7,5,3,1,3,
+};
+static const Uint8 pocadv_mp3_lens24[] = {
+    4,4,6,7,8,9,9,10,10,11,11,11,11,11,12,9,
+    4,4,5,6,7,8,8,9,9,9,10,10,10,10,10,8,
+    6,5,6,7,7,8,8,9,9,9,9,10,10,10,11,7,
+    7,6,7,7,8,8,8,9,9,9,9,10,10,10,10,7,
+    8,7,7,8,8,8,8,9,9,9,10,10,10,10,11,7,
+    9,7,8,8,8,8,9,9,9,9,10,10,10,10,10,7,
+    9,8,8,8,8,9,9,9,9,10,10,10,10,10,11,7,
+    10,8,8,8,9,9,9,9,10,10,10,10,10,11,11,8,
+    10,9,9,9,9,9,9,9,9,10,10,10,10,11,11,8,
+    10,9,9,9,9,9,9,10,10,10,10,10,11,11,11,8,
+    11,9,9,9,9,10,10,10,10,10,10,11,11,11,11,8,
+    11,10,9,9,9,10,10,10,10,10,10,11,11,11,11,8,
+    11,10,10,10,10,10,10,10,10,10,11,11,11,11,11,8,
+    11,10,10,10,10,10,10,10,11,11,11,11,11,11,11,8,
+    12,10,10,10,10,10,10,11,11,11,11,11,11,11,11,8,
+    8,7,7,7,7,7,7,7,7,7,7,8,8,8,8,4,
+};
+
+// Quadruples of the count1 region; table B is a plain 4-bit inverted value
+static const Uint16 pocadv_mp3_quad_codes[16] = {1, 5, 4, 5, 6, 5, 4, 4, 7, 3, 6, 0, 7, 2, 3, 1};
+static const Uint8 pocadv_mp3_quad_lens[16] = {1, 4, 4, 5, 4, 6, 5, 6, 4, 5, 5, 6, 5, 6, 6, 6};
+
+// Indexed by table_select; 16 serves 16-23 and 17 serves 24-31 with more
+// linbits. Tables 4 and 14 don't exist.
+static PocadvMp3Table pocadv_mp3_tables[18] = {
+    {NULL, NULL, 0, 0, NULL},
+    {pocadv_mp3_codes1, pocadv_mp3_lens1, 4, 2, NULL},
+    {pocadv_mp3_codes2, pocadv_mp3_lens2, 9, 3, NULL},
+    {pocadv_mp3_codes3, pocadv_mp3_lens3, 9, 3, NULL},
+    {NULL, NULL, 0, 0, NULL},
+    {pocadv_mp3_codes5, pocadv_mp3_lens5, 16, 4, NULL},
+    {pocadv_mp3_codes6, pocadv_mp3_lens6, 16, 4, NULL},
+    {pocadv_mp3_codes7, pocadv_mp3_lens7, 36, 6, NULL},
+    {pocadv_mp3_codes8, pocadv_mp3_lens8, 36, 6, NULL},
+    {pocadv_mp3_codes9, pocadv_mp3_lens9, 36, 6, NULL},
+    {pocadv_mp3_codes10, pocadv_mp3_lens10, 64, 8, NULL},
+    {pocadv_mp3_codes11, pocadv_mp3_lens11, 64, 8, NULL},
+    {pocadv_mp3_codes12, pocadv_mp3_lens12, 64, 8, NULL},
+    {pocadv_mp3_codes13, pocadv_mp3_lens13, 256, 16, NULL},
+    {NULL, NULL, 0, 0, NULL},
+    {pocadv_mp3_codes15, pocadv_mp3_lens15, 256, 16, NULL},
+    {pocadv_mp3_codes16, pocadv_mp3_lens16, 256, 16, NULL},
+    {pocadv_mp3_codes24, pocadv_mp3_lens24, 256, 16, NULL},
+};
+static PocadvMp3Table pocadv_mp3_quad_table = {pocadv_mp3_quad_codes, pocadv_mp3_quad_lens, 16, 0, NULL};
+
+// Tables computed by pocadv_mp3_init
+static int pocadv_mp3_ready = 0;
+static Sint16 pocadv_mp3_tree_pool[2 * 1394]; // a node per symbol of every table
+static float pocadv_mp3_pow43[8207];          // |x|^(4/3) up to 15 + 2^13 - 1
+static float pocadv_mp3_alias_cs[8], pocadv_mp3_alias_ca[8];
+static float pocadv_mp3_is_ratio[7][2];      // intensity stereo gains, left and right
+static float pocadv_mp3_imdct_long[36][18];
+static float pocadv_mp3_imdct_short[12][6];
+static float pocadv_mp3_windows[4][36];      // by block type; [2] is the 12-sample short window
+static float pocadv_mp3_synth_cos[64][32];
+static float pocadv_mp3_synth_window[512];
+
+// Builds a binary tree from a table's codes. Leaves hold -(symbol + 1);
+// node 0 is the root, so a 0 child means no code goes that way.
+static void pocadv_mp3_build_tree(PocadvMp3Table *t, Sint16 **pool) {
+    Sint16 *tree = *pool;
+    int nodes = 1;
+    for (int s = 0; s < t->count; s++) {
+        int node = 0;
+        for (int bit = t->lens[s] - 1; bit > 0; bit--) {
+            Sint16 *child = &tree[2 * node + ((t->codes[s] >> bit) & 1)];
+            if (*child == 0) *child = (Sint16)nodes++;
+            node = *child;
+        }
+        tree[2 * node + (t->codes[s] & 1)] = (Sint16)(-s - 1);
+    }
+    t->tree = tree;
+    *pool += 2 * t->count;
+}
+
+// Called from pocadv_mp3_open, before any worker thread can decode
+static void pocadv_mp3_init() {
+    if (pocadv_mp3_ready) return;
+    const double pi = 3.14159265358979323846;
+
+    Sint16 *pool = pocadv_mp3_tree_pool;
+    for (int i = 0; i < 18; i++) {
+        if (pocadv_mp3_tables[i].codes) pocadv_mp3_build_tree(&pocadv_mp3_tables[i], &pool);
+    }
+    pocadv_mp3_build_tree(&pocadv_mp3_quad_table, &pool);
+
+    for (int i = 0; i < 8207; i++) pocadv_mp3_pow43[i] = (float)SDL_pow(i, 4.0 / 3.0);
+    for (int i = 0; i < 8; i++) {
+        double c = pocadv_mp3_alias_coefs[i];
+        pocadv_mp3_alias_cs[i] = (float)(1.0 / SDL_sqrt(1.0 + c * c));
+        pocadv_mp3_alias_ca[i] = (float)(c / SDL_sqrt(1.0 + c * c));
+    }
+    for (int i = 0; i < 7; i++) {
+        double ratio = SDL_tan(i * pi / 12.0);
+        pocadv_mp3_is_ratio[i][0] = i == 6 ? 1.0f : (float)(ratio / (1.0 + ratio));
+        pocadv_mp3_is_ratio[i][1] = i == 6 ? 0.0f : (float)(1.0 / (1.0 + ratio));
+    }
+
+    for (int i = 0; i < 36; i++) {
+        for (int k = 0; k < 18; k++) pocadv_mp3_imdct_long[i][k] = (float)SDL_cos(pi / 72.0 * (2 * i + 19) * (2 * k + 1));
+    }
+    for (int i = 0; i < 12; i++) {
+        for (int k = 0; k < 6; k++) pocadv_mp3_imdct_short[i][k] = (float)SDL_cos(pi / 24.0 * (2 * i + 7) * (2 * k + 1));
+    }
+    for (int i = 0; i < 36; i++) {
+        double normal = SDL_sin(pi / 36.0 * (i + 0.5));
+        pocadv_mp3_windows[0][i] = (float)normal;
+        pocadv_mp3_windows[1][i] = (float)(i < 18 ? normal : i < 24 ? 1.0 : i < 30 ? SDL_sin(pi / 12.0 * (i - 17.5)) : 0.0);
+        pocadv_mp3_windows[3][i] = (float)(i < 6 ? 0.0 : i < 12 ? SDL_sin(pi / 12.0 * (i - 5.5)) : i < 18 ? 1.0 : normal);
+        if (i < 12) pocadv_mp3_windows[2][i] = (float)SDL_sin(pi / 12.0 * (i + 0.5));
+    }
+
+    for (int i = 0; i < 64; i++) {
+        for (int k = 0; k < 32; k++) pocadv_mp3_synth_cos[i][k] = (float)SDL_cos((16 + i) * (2 * k + 1) * pi / 64.0);
+    }
+    for (int i = 0; i < 512; i++) {
+        Sint32 base = pocadv_mp3_window_base[i <= 256 ? i : 512 - i];
+        pocadv_mp3_synth_window[i] = (float)((i / 64) & 1 ? -base : base) / 65536.0f;
+    }
+    pocadv_mp3_ready = 1;
+}
+
+static Uint32 pocadv_bits_read(PocadvBits *b, int n) {
+    Uint32 v = 0;
+    for (int i = 0; i < n; i++, b->pos++) {
+        int bit = b->pos < b->end ? (b->data[b->pos >> 3] >> (7 - (b->pos & 7))) & 1 : 0;
+        v = (v << 1) | (Uint32)bit;
+    }
+    return v;
+}
+
+static int pocadv_mp3_symbol(PocadvBits *b, const Sint16 *tree) {
+    int node = 0;
+    do {
+        node = tree[2 * node + pocadv_bits_read(b, 1)];
+    } while (node > 0);
+    return node < 0 ? -node - 1 : 0;
+}
+
+static Uint32 pocadv_read_be32(const Uint8 *p) {
+    return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | (Uint32)p[3];
+}
+
+static int pocadv_mp3_header(const Uint8 *p, PocadvMp3Header *h) {
+    if (p[0] != 0xFF || (p[1] & 0xFE) != 0xFA) return -1; // sync, MPEG-1, Layer III
+    int bitrate = p[2] >> 4, sr_index = (p[2] >> 2) & 3;
+    if (bitrate == 0 || bitrate == 15 || sr_index == 3) return -1;
+
+    h->sr_index = sr_index;
+    h->freq = pocadv_mp3_freqs[sr_index];
+    h->crc = !(p[1] & 1);
+    h->mode = p[3] >> 6;
+    h->mode_ext = (p[3] >> 4) & 3;
+    h->channels = h->mode == 3 ? 1 : 2;
+    h->bytes = 144000 * pocadv_mp3_bitrates[bitrate] / h->freq + ((p[2] >> 1) & 1);
+    return 0;
+}
+
+static size_t pocadv_mp3_read_at(PocadvMp3 *d, Sint64 offset, void *buf, size_t n) {
+    if (d->file_pos != offset) {
+        if (SDL_RWseek(d->file, offset, RW_SEEK_SET) < 0) return 0;
+        d->file_pos = offset;
+    }
+    size_t got = SDL_RWread(d->file, buf, 1, n);
+    d->file_pos += (Sint64)got;
+    return got;
+}
+
+// Reads the header of the frame at `offset`; -1 at the end of the stream
+static int pocadv_mp3_peek(PocadvMp3 *d, Sint64 offset, Uint8 *p, PocadvMp3Header *h) {
+    if (pocadv_mp3_read_at(d, offset, p, 4) != 4 || pocadv_mp3_header(p, h) < 0) return -1;
+    return h->freq == d->freq && h->channels == d->channels ? 0 : -1;
+}
+
+// Frame offsets are recorded the first time decoding or a seek passes them
+static void pocadv_mp3_index(PocadvMp3 *d, int frame, Sint64 offset) {
+    if (frame != d->index_count * POCADV_MP3_INDEX_STEP ||
+        pocadv_reserve((void**)&d->index, &d->index_capacity, d->index_count + 1, sizeof(Sint64)) < 0) return;
+    d->index[d->index_count++] = offset;
+}
+
+static void pocadv_mp3_scalefactors(PocadvBits *b, const PocadvMp3Channel *gc, int gr, const int *scfsi,
+                                    PocadvMp3Scalefac *sf) {
+    int slen1 = pocadv_mp3_slen[gc->scalefac_compress][0];
+    int slen2 = pocadv_mp3_slen[gc->scalefac_compress][1];
+
+    if (gc->block_type == 2) {
+        int sfb = 0;
+        if (gc->mixed_block) {
+            for (; sfb < 8; sfb++) sf->l[sfb] = (int)pocadv_bits_read(b, slen1);
+            sfb = 3;
+        }
+        for (; sfb < 12; sfb++) {
+            for (int w = 0; w < 3; w++) sf->s[sfb][w] = (int)pocadv_bits_read(b, sfb < 6 ? slen1 : slen2);
+        }
+        sf->s[12][0] = sf->s[12][1] = sf->s[12][2] = 0;
+        return;
+    }
+
+    // Granule 1 may share groups of bands with granule 0, which left them in sf
+    static const int groups[5] = {0, 6, 11, 16, 21};
+    for (int g = 0; g < 4; g++) {
+        if (gr == 1 && scfsi[g]) continue;
+        for (int sfb = groups[g]; sfb < groups[g + 1]; sfb++) sf->l[sfb] = (int)pocadv_bits_read(b, g < 2 ? slen1 : slen2);
+    }
+    sf->l[21] = 0;
+}
+
+// Decodes the quantized values of one channel up to bit `end`. Returns how
+// many leading values may be nonzero.
+static int pocadv_mp3_huffman(PocadvBits *b, const PocadvMp3Channel *gc, int sr_index, int end, int *is) {
+    const Uint16 *bands = pocadv_mp3_long_bands[sr_index];
+    int big = gc->big_values * 2 < 576 ? gc->big_values * 2 : 576;
+    int region1 = 36, region2 = 576;
+    if (gc->block_type == 0) {
+        int r1 = gc->region0_count + 1, r2 = r1 + gc->region1_count + 1;
+        region1 = bands[r1 < 22 ? r1 : 22];
+        region2 = bands[r2 < 22 ? r2 : 22];
+    }
+
+    int i = 0;
+    for (; i < big; i += 2) {
+        int select = gc->table_select[i < region1 ? 0 : i < region2 ? 1 : 2];
+        const PocadvMp3Table *t = &pocadv_mp3_tables[select < 16 ? select : select < 24 ? 16 : 17];
+        int x = 0, y = 0;
+        if (t->tree) {
+            int symbol = pocadv_mp3_symbol(b, t->tree);
+            int linbits = pocadv_mp3_linbits[select];
+            x = symbol / t->dim;
+            y = symbol % t->dim;
+            if (x == 15 && linbits) x += (int)pocadv_bits_read(b, linbits);
+            if (x && pocadv_bits_read(b, 1)) x = -x;
+            if (y == 15 && linbits) y += (int)pocadv_bits_read(b, linbits);
+            if (y && pocadv_bits_read(b, 1)) y = -y;
+        }
+        is[i] = x;
+        is[i + 1] = y;
+    }
+
+    // The count1 region holds values of at most 1, four at a time. A
+    // quadruple that runs past the end is stuffing, not data.
+    while (i <= 572 && b->pos < end) {
+        int symbol = gc->count1_table ? 15 - (int)pocadv_bits_read(b, 4) : pocadv_mp3_symbol(b, pocadv_mp3_quad_table.tree);
+        int v[4];
+        for (int k = 0; k < 4; k++) {
+            v[k] = (symbol >> (3 - k)) & 1;
+            if (v[k] && pocadv_bits_read(b, 1)) v[k] = -1;
+        }
+        if (b->pos > end) break;
+        for (int k = 0; k < 4; k++) is[i + k] = v[k];
+        i += 4;
+    }
+
+    int nonzero = i;
+    for (; i < 576; i++) is[i] = 0;
+    return nonzero;
+}
+
+// 2^(q/4)
+static float pocadv_mp3_gain(int q) {
+    static const float quarters[4] = {1.0f, 1.18920712f, 1.41421356f, 1.68179283f};
+    return SDL_scalbnf(quarters[q & 3], (q - (q & 3)) / 4);
+}
+
+static float pocadv_mp3_requantize_value(int v, float gain) {
+    return v < 0 ? -gain * pocadv_mp3_pow43[-v] : gain * pocadv_mp3_pow43[v];
+}
+
+// Scales the quantized values back into the spectrum. Short blocks stay in
+// the bitstream's order: by band, then window, then frequency.
+static void pocadv_mp3_requantize(const PocadvMp3Channel *gc, const PocadvMp3Scalefac *sf, int sr_index,
+                                  const int *is, int nonzero, float *xr) {
+    const Uint16 *long_bands = pocadv_mp3_long_bands[sr_index];
+    const Uint16 *short_bands = pocadv_mp3_short_bands[sr_index];
+    int shift = gc->scalefac_scale ? 4 : 2; // in quarter steps of gain
+    int long_end = gc->block_type != 2 ? 22 : gc->mixed_block ? 8 : 0;
+
+    int i = 0;
+    for (int sfb = 0; sfb < long_end && i < nonzero; sfb++) {
+        int q = gc->global_gain - 210 - shift * (sf->l[sfb] + (gc->preflag ? pocadv_mp3_pretab[sfb] : 0));
+        float gain = pocadv_mp3_gain(q);
+        for (; i < long_bands[sfb + 1]; i++) xr[i] = pocadv_mp3_requantize_value(is[i], gain);
+    }
+    if (gc->block_type == 2) {
+        for (int sfb = gc->mixed_block ? 3 : 0; sfb < 13 && i < nonzero; sfb++) {
+            int width = short_bands[sfb + 1] - short_bands[sfb];
+            for (int w = 0; w < 3; w++) {
+                int q = gc->global_gain - 210 - 8 * gc->subblock_gain[w] - shift * sf->s[sfb][w];
+                float gain = pocadv_mp3_gain(q);
+                for (int j = 0; j < width; j++, i++) xr[i] = pocadv_mp3_requantize_value(is[i], gain);
+            }
+        }
+    }
+    for (; i < 576; i++) xr[i] = 0.0f;
+}
+
+static int pocadv_mp3_zero(const float *xr, int start, int n) {
+    for (int i = start; i < start + n; i++) {
+        if (xr[i] != 0.0f) return 0;
+    }
+    return 1;
+}
+
+// Applies intensity stereo to one band if its position is valid, and marks
+// its lines as done
+static void pocadv_mp3_intensity(float xr[2][576], Uint8 *done, int start, int n, int is_pos) {
+    if (is_pos >= 7) return;
+    for (int i = start; i < start + n; i++) {
+        float v = xr[0][i];
+        xr[0][i] = v * pocadv_mp3_is_ratio[is_pos][0];
+        xr[1][i] = v * pocadv_mp3_is_ratio[is_pos][1];
+        done[i] = 1;
+    }
+}
+
+// Joint stereo. Above the last nonzero band of the right channel, intensity
+// stereo rebuilds both channels from the left; mid/side covers the rest.
+static void pocadv_mp3_stereo(const PocadvMp3Header *h, const PocadvMp3Channel *gc,
+                              const PocadvMp3Scalefac *right, float xr[2][576]) {
+    Uint8 done[576] = {0};
+
+    if (h->mode_ext & 1) {
+        const Uint16 *long_bands = pocadv_mp3_long_bands[h->sr_index];
+        if (gc->block_type == 2) {
+            const Uint16 *short_bands = pocadv_mp3_short_bands[h->sr_index];
+            int first_short = gc->mixed_block ? 3 : 0, short_zero = 1;
+            for (int w = 0; w < 3; w++) {
+                int sfb = 12;
+                for (; sfb >= first_short; sfb--) {
+                    int width = short_bands[sfb + 1] - short_bands[sfb];
+                    if (!pocadv_mp3_zero(xr[1], 3 * short_bands[sfb] + w * width, width)) break;
+                }
+                if (sfb >= first_short) short_zero = 0;
+                for (sfb++; sfb < 13; sfb++) {
+                    int width = short_bands[sfb + 1] - short_bands[sfb];
+                    pocadv_mp3_intensity(xr, done, 3 * short_bands[sfb] + w * width, width, right->s[sfb < 12 ? sfb : 11][w]);
+                }
+            }
+            if (gc->mixed_block && short_zero) {
+                int sfb = 7;
+                while (sfb >= 0 && pocadv_mp3_zero(xr[1], long_bands[sfb], long_bands[sfb + 1] - long_bands[sfb])) sfb--;
+                for (sfb++; sfb < 8; sfb++) {
+                    pocadv_mp3_intensity(xr, done, long_bands[sfb], long_bands[sfb + 1] - long_bands[sfb], right->l[sfb]);
+                }
+            }
+        } else {
+            int sfb = 21;
+            while (sfb >= 0 && pocadv_mp3_zero(xr[1], long_bands[sfb], long_bands[sfb + 1] - long_bands[sfb])) sfb--;
+            for (sfb++; sfb < 22; sfb++) {
+                pocadv_mp3_intensity(xr, done, long_bands[sfb], long_bands[sfb + 1] - long_bands[sfb],
+                                     right->l[sfb < 21 ? sfb : 20]);
+            }
+        }
+    }
+
+    if (h->mode_ext & 2) {
+        for (int i = 0; i < 576; i++) {
+            if (done[i]) continue;
+            float mid = xr[0][i], side = xr[1][i];
+            xr[0][i] = (mid + side) * 0.70710678f;
+            xr[1][i] = (mid - side) * 0.70710678f;
+        }
+    }
+}
+
+// Undoes the encoder's butterflies between neighbouring long-block subbands
+static void pocadv_mp3_antialias(const PocadvMp3Channel *gc, float *xr) {
+    int subbands = gc->block_type != 2 ? 32 : gc->mixed_block ? 2 : 0;
+    for (int sb = 1; sb < subbands; sb++) {
+        for (int i = 0; i < 8; i++) {
+            float lo = xr[18 * sb - 1 - i], hi = xr[18 * sb + i];
+            xr[18 * sb - 1 - i] = lo * pocadv_mp3_alias_cs[i] - hi * pocadv_mp3_alias_ca[i];
+            xr[18 * sb + i] = hi * pocadv_mp3_alias_cs[i] + lo * pocadv_mp3_alias_ca[i];
+        }
+    }
+}
+
+// IMDCT with overlap-add, turning one channel's spectrum into 18 samples
+// of each of the 32 subbands
+static void pocadv_mp3_hybrid(PocadvMp3 *d, int ch, const PocadvMp3Channel *gc, int sr_index, const float *xr,
+                              float out[18][32]) {
+    // Short blocks: gather each subband's 6 lines per window together
+    float lines[576];
+    if (gc->block_type == 2) {
+        const Uint16 *short_bands = pocadv_mp3_short_bands[sr_index];
+        int sfb = gc->mixed_block ? 3 : 0;
+        memcpy(lines, xr, 36 * sizeof(float));
+        for (; sfb < 13; sfb++) {
+            int width = short_bands[sfb + 1] - short_bands[sfb];
+            for (int w = 0; w < 3; w++) {
+                for (int j = 0; j < width; j++) {
+                    int f = short_bands[sfb] + j;
+                    lines[(f / 6) * 18 + w * 6 + f % 6] = xr[3 * short_bands[sfb] + w * width + j];
+                }
+            }
+        }
+        xr = lines;
+    }
+
+    float *overlap = d->overlap[ch];
+    for (int sb = 0; sb < 32; sb++) {
+        const float *in = xr + 18 * sb;
+        int type = gc->mixed_block && sb < 2 ? 0 : gc->block_type;
+        float z[36];
+
+        if (type == 2) {
+            SDL_memset(z, 0, sizeof(z));
+            for (int w = 0; w < 3; w++) {
+                for (int i = 0; i < 12; i++) {
+                    float sum = 0.0f;
+                    for (int k = 0; k < 6; k++) sum += in[6 * w + k] * pocadv_mp3_imdct_short[i][k];
+                    z[6 + 6 * w + i] += sum * pocadv_mp3_windows[2][i];
+                }
+            }
+        } else {
+            for (int i = 0; i < 36; i++) {
+                float sum = 0.0f;
+                for (int k = 0; k < 18; k++) sum += in[k] * pocadv_mp3_imdct_long[i][k];
+                z[i] = sum * pocadv_mp3_windows[type][i];
+            }
+        }
+
+        // Odd subbands are frequency-inverted: every other sample flips sign
+        for (int i = 0; i < 18; i++) {
+            float v = z[i] + overlap[18 * sb + i];
+            out[i][sb] = (sb & i & 1) ? -v : v;
+            overlap[18 * sb + i] = z[18 + i];
+        }
+    }
+}
+
+// Polyphase synthesis: 18 rounds of 32 subband samples into 32 PCM samples
+static void pocadv_mp3_synth(PocadvMp3 *d, int ch, float in[18][32], Sint16 *pcm) {
+    float *v = d->synth[ch];
+    for (int t = 0; t < 18; t++) {
+        int pos = d->synth_pos[ch] = (d->synth_pos[ch] - 64) & 1023;
+        for (int i = 0; i < 64; i++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 32; k++) sum += pocadv_mp3_synth_cos[i][k] * in[t][k];
+            v[pos + i] = sum;
+        }
+
+        for (int j = 0; j < 32; j++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 16; i++) {
+                int n = (i >> 1) * 128 + (i & 1 ? 96 : 0) + j;
+                sum += v[(pos + n) & 1023] * pocadv_mp3_synth_window[j + 32 * i];
+            }
+            float s = sum * 32768.0f;
+            int sample = (int)(s < 0.0f ? s - 0.5f : s + 0.5f);
+            if (sample > 32767) sample = 32767;
+            if (sample < -32768) sample = -32768;
+            pcm[(t * 32 + j) * d->channels] = (Sint16)sample;
+        }
+    }
+}
+
+static void pocadv_mp3_reset(PocadvMp3 *d) {
+    d->main_data_len = 0;
+    SDL_memset(d->overlap, 0, sizeof(d->overlap));
+    SDL_memset(d->synth, 0, sizeof(d->synth));
+    d->synth_pos[0] = d->synth_pos[1] = 0;
+    d->pcm_pos = 1152;
+}
+
+// Decodes the next frame into d->pcm; -1 at the end of the stream
+static int pocadv_mp3_decode_frame(PocadvMp3 *d) {
+    Uint8 frame[POCADV_MP3_MAX_FRAME];
+    PocadvMp3Header h;
+    if (pocadv_mp3_peek(d, d->offset, frame, &h) < 0) return -1;
+
+    int nch = h.channels;
+    int side_start = 4 + (h.crc ? 2 : 0);
+    int main_start = side_start + (nch == 1 ? 17 : 32);
+    if (h.bytes < main_start ||
+        pocadv_mp3_read_at(d, d->offset + 4, frame + 4, h.bytes - 4) != (size_t)(h.bytes - 4)) return -1;
+
+    pocadv_mp3_index(d, d->frame, d->offset);
+    d->offset += h.bytes;
+    d->pcm_start = (Uint64)d->frame * 1152;
+    d->frame++;
+
+    PocadvBits b = {frame + side_start, 0, (main_start - side_start) * 8};
+    int main_data_begin = (int)pocadv_bits_read(&b, 9);
+    pocadv_bits_read(&b, nch == 1 ? 5 : 3); // private bits
+    int scfsi[2][4];
+    for (int ch = 0; ch < nch; ch++) {
+        for (int g = 0; g < 4; g++) scfsi[ch][g] = (int)pocadv_bits_read(&b, 1);
+    }
+
+    PocadvMp3Channel side[2][2];
+    for (int gr = 0; gr < 2; gr++) {
+        for (int ch = 0; ch < nch; ch++) {
+            PocadvMp3Channel *gc = &side[gr][ch];
+            gc->part2_3_length = (int)pocadv_bits_read(&b, 12);
+            gc->big_values = (int)pocadv_bits_read(&b, 9);
+            gc->global_gain = (int)pocadv_bits_read(&b, 8);
+            gc->scalefac_compress = (int)pocadv_bits_read(&b, 4);
+            if (pocadv_bits_read(&b, 1)) {
+                gc->block_type = (int)pocadv_bits_read(&b, 2);
+                gc->mixed_block = (int)pocadv_bits_read(&b, 1);
+                for (int i = 0; i < 2; i++) gc->table_select[i] = (int)pocadv_bits_read(&b, 5);
+                gc->table_select[2] = 0;
+                for (int i = 0; i < 3; i++) gc->subblock_gain[i] = (int)pocadv_bits_read(&b, 3);
+                if (gc->block_type == 0) gc->block_type = 1; // reserved; treat as a start block
+                gc->region0_count = gc->region1_count = 0;   // regions are fixed
+            } else {
+                gc->block_type = gc->mixed_block = 0;
+                for (int i = 0; i < 3; i++) gc->table_select[i] = (int)pocadv_bits_read(&b, 5);
+                gc->subblock_gain[0] = gc->subblock_gain[1] = gc->subblock_gain[2] = 0;
+                gc->region0_count = (int)pocadv_bits_read(&b, 4);
+                gc->region1_count = (int)pocadv_bits_read(&b, 3);
+            }
+            gc->preflag = (int)pocadv_bits_read(&b, 1);
+            gc->scalefac_scale = (int)pocadv_bits_read(&b, 1);
+            gc->count1_table = (int)pocadv_bits_read(&b, 1);
+        }
+    }
+
+    // This frame's main data may start in earlier frames, in the reservoir.
+    // Until enough of it is there (after a seek) the frame decodes as silence.
+    int start = d->main_data_len - main_data_begin;
+    memcpy(d->main_data + d->main_data_len, frame + main_start, (size_t)(h.bytes - main_start));
+    d->main_data_len += h.bytes - main_start;
+    PocadvBits m = {d->main_data, start * 8, d->main_data_len * 8};
+
+    for (int gr = 0; gr < 2; gr++) {
+        float xr[2][576];
+        for (int ch = 0; ch < nch; ch++) {
+            const PocadvMp3Channel *gc = &side[gr][ch];
+            int is[576];
+            if (start < 0) {
+                SDL_memset(xr[ch], 0, sizeof(xr[ch]));
+                continue;
+            }
+            int end = m.pos + gc->part2_3_length;
+            pocadv_mp3_scalefactors(&m, gc, gr, scfsi[ch], &d->scalefac[ch]);
+            int nonzero = pocadv_mp3_huffman(&m, gc, h.sr_index, end, is);
+            pocadv_mp3_requantize(gc, &d->scalefac[ch], h.sr_index, is, nonzero, xr[ch]);
+            m.pos = end;
+        }
+        if (h.mode == 1 && start >= 0) pocadv_mp3_stereo(&h, &side[gr][0], &d->scalefac[1], xr);
+
+        for (int ch = 0; ch < nch; ch++) {
+            float bands[18][32];
+            pocadv_mp3_antialias(&side[gr][ch], xr[ch]);
+            pocadv_mp3_hybrid(d, ch, &side[gr][ch], h.sr_index, xr[ch], bands);
+            pocadv_mp3_synth(d, ch, bands, d->pcm + gr * 576 * nch + ch);
+        }
+    }
+
+    // Keep only what later frames can reach back to
+    if (d->main_data_len > POCADV_MP3_RESERVOIR) {
+        memmove(d->main_data, d->main_data + d->main_data_len - POCADV_MP3_RESERVOIR, POCADV_MP3_RESERVOIR);
+        d->main_data_len = POCADV_MP3_RESERVOIR;
+    }
+    return 0;
+}
+
+// Starts decoding `file` if it holds MPEG-1 Layer III audio, after any ID3v2
+// tag. A leading Xing/Info frame is skipped, and the LAME tag inside it gives
+// the encoder delay and padding to trim for gapless playback.
+static PocadvMp3* pocadv_mp3_open(SDL_RWops *file) {
+    Uint8 frame[POCADV_MP3_MAX_FRAME];
+    Sint64 start = 0;
+    if (SDL_RWread(file, frame, 1, 10) != 10) return NULL;
+    if (memcmp(frame, "ID3", 3) == 0) {
+        start = 10 + ((Sint64)(frame[6] & 0x7F) << 21 | (frame[7] & 0x7F) << 14 |
+                      (frame[8] & 0x7F) << 7 | (frame[9] & 0x7F));
+        if (frame[5] & 0x10) start += 10; // footer
+    }
+
+    PocadvMp3Header h;
+    if (SDL_RWseek(file, start, RW_SEEK_SET) < 0 || SDL_RWread(file, frame, 1, 4) != 4 ||
+        pocadv_mp3_header(frame, &h) < 0 || SDL_RWread(file, frame + 4, 1, h.bytes - 4) != (size_t)(h.bytes - 4))
+        return NULL;
+
+    pocadv_mp3_init();
+    PocadvMp3 *d = (PocadvMp3*)calloc(1, sizeof(PocadvMp3));
+    if (!d) return NULL;
+    d->file = file;
+    d->file_pos = start + h.bytes;
+    d->freq = h.freq;
+    d->channels = h.channels;
+    d->first_frame = start;
+
+    const Uint8 *tag = frame + 4 + (h.crc ? 2 : 0) + (h.channels == 1 ? 17 : 32);
+    const Uint8 *frame_end = frame + h.bytes;
+    if (tag + 8 <= frame_end && (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0)) {
+        Uint32 flags = pocadv_read_be32(tag + 4);
+        const Uint8 *p = tag + 8;
+        Uint32 frames = 0;
+        if ((flags & 1) && p + 4 <= frame_end) frames = pocadv_read_be32(p);
+        p += ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) + ((flags & 8) ? 4 : 0);
+
+        // LAME, and ffmpeg which writes the same tag
+        if (p + 24 <= frame_end && (memcmp(p, "LAME", 4) == 0 || memcmp(p, "Lav", 3) == 0)) {
+            Uint32 delay = ((Uint32)p[21] << 4) | (p[22] >> 4);
+            Uint32 padding = ((Uint32)(p[22] & 0x0F) << 8) | p[23];
+            d->skip = delay + POCADV_MP3_DECODER_DELAY;
+            if ((Uint64)frames * 1152 > delay + padding) d->length = (Uint64)frames * 1152 - delay - padding;
+        }
+        d->first_frame = start + h.bytes;
+    }
+
+    d->offset = d->first_frame;
+    d->want = d->skip;
+    pocadv_mp3_reset(d);
+    return d;
+}
+
+static void pocadv_mp3_close(PocadvMp3 *d) {
+    free(d->index);
+    free(d);
+}
+
+// Copies up to max_frames decoded sample frames to `out`; 0 at the end
+static int pocadv_mp3_read(PocadvMp3 *d, Sint16 *out, int max_frames) {
+    Uint64 end = d->length ? d->skip + d->length : ~(Uint64)0;
+    int done = 0;
+    while (done < max_frames) {
+        if (d->pcm_pos == 1152) {
+            if ((Uint64)d->frame * 1152 >= end || pocadv_mp3_decode_frame(d) < 0) break;
+            d->pcm_pos = 0;
+        }
+
+        Uint64 position = d->pcm_start + (Uint64)d->pcm_pos;
+        if (position >= end) break;
+        if (position < d->want) {
+            Uint64 drop = d->want - position;
+            d->pcm_pos = drop < (Uint64)(1152 - d->pcm_pos) ? d->pcm_pos + (int)drop : 1152;
+            continue;
+        }
+
+        int n = 1152 - d->pcm_pos;
+        if (n > max_frames - done) n = max_frames - done;
+        if ((Uint64)n > end - position) n = (int)(end - position);
+        memcpy(out + (size_t)done * d->channels, d->pcm + d->pcm_pos * d->channels,
+               (size_t)n * d->channels * sizeof(Sint16));
+        d->pcm_pos += n;
+        done += n;
+    }
+    return done;
+}
+
+// Finds frame n by walking headers from the nearest index entry before it
+static Sint64 pocadv_mp3_locate(PocadvMp3 *d, int n) {
+    pocadv_mp3_index(d, 0, d->first_frame);
+    if (d->index_count == 0) return -1;
+
+    int k = n / POCADV_MP3_INDEX_STEP;
+    if (k >= d->index_count) k = d->index_count - 1;
+    int frame = k * POCADV_MP3_INDEX_STEP;
+    Sint64 offset = d->index[k];
+    while (frame < n) {
+        Uint8 p[4];
+        PocadvMp3Header h;
+        if (pocadv_mp3_peek(d, offset, p, &h) < 0) return -1;
+        offset += h.bytes;
+        pocadv_mp3_index(d, ++frame, offset);
+    }
+    return offset;
+}
+
+// Moves to `sample` of the track. Decoding restarts a few frames early so
+// the bit reservoir and filter banks are primed, and the output is the
+// same as if the track had played through to there.
+static int pocadv_mp3_seek(PocadvMp3 *d, Uint64 sample) {
+    Uint64 target = d->skip + sample;
+    if (d->length && sample > d->length) return -1;
+
+    int frame = (int)(target / 1152);
+    int first = frame > POCADV_MP3_SEEK_PRIME ? frame - POCADV_MP3_SEEK_PRIME : 0;
+    Sint64 offset = pocadv_mp3_locate(d, first);
+    if (offset < 0) return -1;
+
+    pocadv_mp3_reset(d);
+    d->offset = offset;
+    d->frame = first;
+    d->want = target;
+    return 0;
+}
+
+// Decodes a whole file into a buffer SDL_FreeWAV can free
+static int pocadv_mp3_load(PocadvMp3 *d, SDL_AudioSpec *spec, Uint8 **buffer, Uint32 *length) {
+    size_t frame_size = (size_t)d->channels * sizeof(Sint16);
+    Uint32 capacity = d->length ? (Uint32)d->length : 1152 * 256, frames = 0;
+    Sint16 *data = (Sint16*)SDL_malloc(capacity * frame_size);
+    if (!data) return -1;
+
+    int n;
+    while ((n = pocadv_mp3_read(d, data + (size_t)frames * d->channels, (int)(capacity - frames))) > 0) {
+        frames += (Uint32)n;
+        if (d->length && frames == d->length) break; // reads stop at the gapless end
+        if (frames < capacity) continue;
+
+        Sint16 *grown = (Sint16*)SDL_realloc(data, (size_t)capacity * 2 * frame_size);
+        if (!grown) {
+            SDL_free(data);
+            return -1;
+        }
+        data = grown;
+        capacity *= 2;
+    }
+    if (frames == 0) {
+        SDL_free(data);
+        return -1;
+    }
+    if (frames < capacity) {
+        // The buffer may be kept as the sound's PCM, so drop the slack
+        Sint16 *shrunk = (Sint16*)SDL_realloc(data, frames * frame_size);
+        if (shrunk) data = shrunk;
+    }
+
+    SDL_zerop(spec);
+    spec->freq = d->freq;
+    spec->format = AUDIO_S16SYS;
+    spec->channels = (Uint8)d->channels;
+    *buffer = (Uint8*)data;
+    *length = frames * (Uint32)frame_size;
+    return 0;
+}
+
+// ----------------------- Audio ----------------------
+
+// The mixer runs on SDL's audio thread. Playback requests reach it through
+// the command ring; the device lock is only taken to load and free sounds
+// and to read the latency estimate.
+static void pocadv_audio_lock() {
+    if (pocadv_audio_device != 0) SDL_LockAudioDevice(pocadv_audio_device);
+}
+
+static void pocadv_audio_unlock() {
+    if (pocadv_audio_device != 0) SDL_UnlockAudioDevice(pocadv_audio_device);
+}
+
+// Runs on the audio thread, or with the device locked
+static void pocadv_voice_remove(pocadv_Audio *v) {
+    for (int i = 0; i < pocadv_voice_count; i++) {
+        if (pocadv_voices[i] == v) {
+            pocadv_voices[i] = pocadv_voices[--pocadv_voice_count];
+            break;
+        }
+    }
+    v->playing = 0;
+    v->position = 0;
+}
+
+// Runs on the audio thread, or with the device locked
+static void pocadv_voice_apply(int op, pocadv_Audio *v, int loops_remaining) {
+    switch (op) {
+        case POCADV_AUDIO_PLAY:
+            // A voice is in the list exactly while it isn't stopped
+            if (v->playing == 0) pocadv_voices[pocadv_voice_count++] = v;
+            v->position = 0;
+            v->ima.frame = 0; // the voice may have played another sound
+            v->loops_remaining = loops_remaining;
+            v->playing = 1;
+            v->started = pocadv_voice_clock++;
+            break;
+        case POCADV_AUDIO_PAUSE:
+            if (v->playing == 1) v->playing = 2;
+            break;
+        case POCADV_AUDIO_UNPAUSE:
+            if (v->playing == 2) v->playing = 1;
+            break;
+        case POCADV_AUDIO_STOP:
+            pocadv_voice_remove(v);
+            break;
+    }
+}
+
+// Where a ramp has got to
+static float pocadv_ramp_value(const pocadv_Ramp *r) {
+    if (r->pos >= r->length) return r->to;
+
+    float t = (float)r->pos / (float)r->length;
+    if (r->curve == POCADV_FADE_EXPONENTIAL) {
+        float from = r->from > POCADV_MIX_FLOOR ? r->from : POCADV_MIX_FLOOR;
+        float to = r->to > POCADV_MIX_FLOOR ? r->to : POCADV_MIX_FLOOR;
+        return from * SDL_powf(to / from, t);
+    }
+    return r->from + (r->to - r->from) * t;
+}
+
+static void pocadv_ramp_set(pocadv_Ramp *r, float value) {
+    r->from = r->to = value;
+    r->pos = r->length = 0;
+    r->curve = POCADV_FADE_LINEAR;
+}
+
+// Glides from wherever the ramp is now, so changes never jump
+static void pocadv_ramp_start(pocadv_Ramp *r, float to, float seconds, int curve) {
+    if (seconds < POCADV_MIX_GLIDE) seconds = POCADV_MIX_GLIDE;
+    r->from = pocadv_ramp_value(r);
+    r->to = to;
+    r->pos = 0;
+    r->length = (Uint32)(seconds * pocadv_device_spec.freq);
+    r->curve = curve;
+}
+
+static void pocadv_ramp_advance(pocadv_Ramp *r, int frames) {
+    if (r->pos < r->length) r->pos = r->length - r->pos > (Uint32)frames ? r->pos + (Uint32)frames : r->length;
+}
+
+static int pocadv_ramp_at(const pocadv_Ramp *r, float value) {
+    return r->pos >= r->length && r->to == value;
+}
+
+// Runs on the audio thread, or with the device locked. A stopped voice
+// can't click, so it takes changes at once and only a fade waits for it to
+// play.
+static void pocadv_voice_level(pocadv_Audio *v, const PocadvAudioCmd *cmd) {
+    pocadv_Ramp *r = &v->gain;
+    float to = cmd->gain;
+    if (cmd->op == POCADV_AUDIO_PAN) {
+        r = &v->pan;
+        to = cmd->pan;
+    } else if (cmd->op == POCADV_AUDIO_SEND) {
+        r = cmd->bus == POCADV_DRY ? &v->dry : &v->send[cmd->bus];
+    }
+
+    if (v->playing == 0) pocadv_ramp_set(r, r->to);
+    if (v->playing == 0 && cmd->seconds <= 0.0f) pocadv_ramp_set(r, to);
+    else pocadv_ramp_start(r, to, cmd->seconds, cmd->op == POCADV_AUDIO_GAIN ? cmd->curve : POCADV_FADE_LINEAR);
+}
+
+static int pocadv_voice_older(const pocadv_Audio *a, const pocadv_Audio *b) {
+    return (Sint32)(a->started - b->started) < 0; // the clock may wrap
+}
+
+// How loud a voice is now: its sound's peak at the gain it has reached
+static float pocadv_voice_loudness(const pocadv_Audio *v) {
+    return (float)v->sound->peak * pocadv_ramp_value(&v->gain);
+}
+
+// Picks the pooled voice a new instance of `s` plays on: its own oldest
+// instance once it is at its cap, else a free voice, else a stolen one
+static pocadv_Audio* pocadv_voice_pick(const PocadvSound *s, int max_instances) {
+    pocadv_Audio *free_voice = NULL, *oldest = NULL, *quietest = NULL, *oldest_instance = NULL;
+    int instances = 0;
+    float quietest_loudness = 0.0f;
+
+    for (int i = 0; i < POCADV_MAX_VOICES; i++) {
+        pocadv_Audio *v = &pocadv_voice_pool[i];
+        if (v->playing == 0) {
+            if (!free_voice) free_voice = v;
+            continue;
+        }
+        if (v->sound == s) {
+            instances++;
+            if (!oldest_instance || pocadv_voice_older(v, oldest_instance)) oldest_instance = v;
+        }
+        if (!oldest || pocadv_voice_older(v, oldest)) oldest = v;
+        float loudness = pocadv_voice_loudness(v);
+        if (!quietest || loudness < quietest_loudness ||
+            (loudness == quietest_loudness && pocadv_voice_older(v, quietest))) {
+            quietest = v;
+            quietest_loudness = loudness;
+        }
+    }
+
+    if (max_instances > 0 && instances >= max_instances) return oldest_instance;
+    if (free_voice) return free_voice;
+    return pocadv_voice_steal == POCADV_STEAL_QUIETEST ? quietest : oldest;
+}
+
+// Applies queued playback requests. Runs on the audio thread, or on the game
+// thread while it holds the device lock.
+static void pocadv_audio_drain() {
+    Uint32 tail = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_tail);
+    Uint32 head = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_head);
+
+    for (; tail != head; tail++) {
+        const PocadvAudioCmd *cmd = &pocadv_audio_queue[tail & (POCADV_AUDIO_QUEUE_SIZE - 1)];
+
+        int level = cmd->op == POCADV_AUDIO_GAIN || cmd->op == POCADV_AUDIO_PAN || cmd->op == POCADV_AUDIO_SEND;
+        if (cmd->sound && cmd->op == POCADV_AUDIO_SEND) {
+            if (cmd->bus == POCADV_DRY) cmd->sound->dry = cmd->gain;
+            else cmd->sound->send[cmd->bus] = cmd->gain;
+        }
+
+        if (!cmd->sound) {
+            if (level) {
+                pocadv_voice_level(cmd->voice, cmd);
+            } else if (cmd->op == POCADV_AUDIO_LOOP) {
+                cmd->voice->loop_start = cmd->loop_start;
+                cmd->voice->loop_end = cmd->loop_end;
+            } else {
+                pocadv_voice_apply(cmd->op, cmd->voice, cmd->loops_remaining);
+            }
+            if (cmd->op == POCADV_AUDIO_PLAY) cmd->voice->start = cmd->clock;
+        } else if (cmd->op == POCADV_AUDIO_PLAY) {
+            pocadv_Audio *v = pocadv_voice_pick(cmd->sound, cmd->max_instances);
+            v->sound = cmd->sound;
+            pocadv_ramp_set(&v->gain, cmd->gain);
+            pocadv_ramp_set(&v->pan, cmd->pan);
+            pocadv_ramp_set(&v->dry, cmd->sound->dry);
+            for (int b = 0; b < POCADV_MAX_BUSES; b++) pocadv_ramp_set(&v->send[b], cmd->sound->send[b]);
+            pocadv_voice_apply(POCADV_AUDIO_PLAY, v, 0);
+            v->start = cmd->clock;
+        } else {
+            for (int i = 0; i < POCADV_MAX_VOICES; i++) {
+                pocadv_Audio *v = &pocadv_voice_pool[i];
+                if (v->playing == 0 || v->sound != cmd->sound) continue;
+                if (level) pocadv_voice_level(v, cmd);
+                else pocadv_voice_apply(cmd->op, v, 0);
+            }
+        }
+    }
+    SDL_AtomicSet(&pocadv_audio_queue_tail, (int)tail);
+}
+
+// Queues a playback request without blocking. Only when the ring is full
+// does it take the device lock and apply the backlog itself.
+static void pocadv_audio_send(const PocadvAudioCmd *request) {
+    if (pocadv_audio_device == 0) return;
+
+    Uint32 head = (Uint32)SDL_AtomicGet(&pocadv_audio_queue_head);
+    if (head - (Uint32)SDL_AtomicGet(&pocadv_audio_queue_tail) >= POCADV_AUDIO_QUEUE_SIZE) {
+        pocadv_audio_lock();
+        pocadv_audio_drain();
+        pocadv_audio_unlock();
+    }
+
+    pocadv_audio_queue[head & (POCADV_AUDIO_QUEUE_SIZE - 1)] = *request;
+    SDL_AtomicSet(&pocadv_audio_queue_head, (int)(head + 1)); // publishes the command
+}
+
+static void pocadv_audio_push(int op, pocadv_Audio *voice, int loops_remaining) {
+    PocadvAudioCmd cmd = {op, voice, NULL, loops_remaining, 0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0};
+    pocadv_audio_send(&cmd);
+}
+
+static void pocadv_audio_push_sound(int op, PocadvSound *sound) {
+    PocadvAudioCmd cmd = {op, NULL, sound, 0, sound->max_instances, sound->gain, sound->pan, 0.0f, 0, 0, 0, 0, 0};
+    pocadv_audio_send(&cmd);
+}
+
+// Gain or pan change for a voice, or for every instance of a sound
+static void pocadv_audio_push_level(int op, pocadv_Audio *voice, PocadvSound *sound,
+                                    float value, float seconds, pocadv_Fade curve) {
+    if (op == POCADV_AUDIO_GAIN) value = value > 0.0f ? value : 0.0f;
+    else value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    if (sound) {
+        if (op == POCADV_AUDIO_GAIN) sound->gain = value;
+        else sound->pan = value;
+    }
+
+    PocadvAudioCmd cmd = {op, voice, sound, 0, 0, value, value, seconds, curve, 0, 0, 0, 0};
+    pocadv_audio_send(&cmd);
+}
+
+// Send level change for a voice, or for every instance of a sound
+static void pocadv_audio_push_send(pocadv_Audio *voice, PocadvSound *sound, int bus, float level) {
+    if (bus < POCADV_DRY || bus >= pocadv_fx_count) return;
+    PocadvAudioCmd cmd = {POCADV_AUDIO_SEND, voice, sound, 0, 0, level > 0.0f ? level : 0.0f, 0.0f,
+                          0.0f, POCADV_FADE_LINEAR, 0, 0, 0, bus};
+    pocadv_audio_send(&cmd);
+}
+
+static void pocadv_mix_add_scalar(Sint32 *bus, const Sint16 *src, int n) {
+    for (int i = 0; i < n; i++) bus[i] += src[i];
+}
+
+static void pocadv_mix_clip_scalar(Sint16 *out, const Sint32 *bus, int n) {
+    for (int i = 0; i < n; i++) {
+        Sint32 v = bus[i];
+        out[i] = (Sint16)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+}
+
+// Rounds half to even, as the vector kernels' conversions do, so every
+// kernel gives the same samples; adding 1.5 * 2^52 leaves no fraction bits
+static Sint32 pocadv_mix_round(float v) {
+    return (Sint32)((double)v + 6755399441055744.0 - 6755399441055744.0);
+}
+
+// Frames from `done` on, with the gain at frame i computed the way the
+// vector kernels compute it
+static void pocadv_mix_ramp_rest(Sint32 *bus, const Sint16 *src, int frames, int channels,
+                                 const float *gain, const float *step, int done) {
+    for (int c = 0; c < channels; c++) {
+        for (int i = done; i < frames; i++) {
+            float v = src[i * channels + c] * (gain[c] + step[c] * (float)i);
+            bus[i * channels + c] += pocadv_mix_round(v);
+        }
+    }
+}
+
+static void pocadv_mix_ramp_scalar(Sint32 *bus, const Sint16 *src, int frames, int channels,
+                                   const float *gain, const float *step) {
+    pocadv_mix_ramp_rest(bus, src, frames, channels, gain, step, 0);
+}
+
+// Transposed direct form II: z1 and z2 carry each channel's state
+static void pocadv_fx_biquad_scalar(float *buf, int frames, int channels, const float *coefs,
+                                    float *z1, float *z2) {
+    for (int c = 0; c < channels; c++) {
+        float s1 = z1[c], s2 = z2[c];
+        for (int i = 0; i < frames; i++) {
+            float x = buf[i * channels + c], y = coefs[0] * x + s1;
+            s1 = coefs[1] * x - coefs[3] * y + s2;
+            s2 = coefs[2] * x - coefs[4] * y;
+            buf[i * channels + c] = y;
+        }
+        z1[c] = s1;
+        z2[c] = s2;
+    }
+}
+
+#ifdef POCADV_X86
+
+POCADV_TARGET("sse2")
+static void pocadv_mix_add_sse2(Sint32 *bus, const Sint16 *src, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        // Sign-extend by placing each sample in the top half and shifting down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128i *b = (__m128i*)(bus + i);
+        _mm_storeu_si128(b, _mm_add_epi32(_mm_loadu_si128(b), lo));
+        _mm_storeu_si128(b + 1, _mm_add_epi32(_mm_loadu_si128(b + 1), hi));
+    }
+    pocadv_mix_add_scalar(bus + i, src + i, n - i);
+}
+
+POCADV_TARGET("sse2")
+static void pocadv_mix_clip_sse2(Sint16 *out, const Sint32 *bus, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(bus + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(bus + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+    pocadv_mix_clip_scalar(out + i, bus + i, n - i);
+}
+
+// Lane j holds channel j % channels of frame j / channels, so the channel
+// count has to divide the lane count
+POCADV_TARGET("sse2")
+static void pocadv_mix_ramp_sse2(Sint32 *bus, const Sint16 *src, int frames, int channels,
+                                 const float *gain, const float *step) {
+    int n = frames * channels, i = 0;
+    if (4 % channels == 0) {
+        float g[4], d[4], t[4];
+        for (int j = 0; j < 4; j++) {
+            g[j] = gain[j % channels];
+            d[j] = step[j % channels];
+            t[j] = (float)(j / channels);
+        }
+        __m128 base = _mm_loadu_ps(g), slope = _mm_loadu_ps(d), at = _mm_loadu_ps(t);
+        __m128 next = _mm_set1_ps((float)(4 / channels));
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+            lo = _mm_mul_ps(lo, _mm_add_ps(base, _mm_mul_ps(slope, at)));
+            at = _mm_add_ps(at, next);
+            hi = _mm_mul_ps(hi, _mm_add_ps(base, _mm_mul_ps(slope, at)));
+            at = _mm_add_ps(at, next);
+            __m128i *b = (__m128i*)(bus + i);
+            _mm_storeu_si128(b, _mm_add_epi32(_mm_loadu_si128(b), _mm_cvtps_epi32(lo)));
+            _mm_storeu_si128(b + 1, _mm_add_epi32(_mm_loadu_si128(b + 1), _mm_cvtps_epi32(hi)));
+        }
+    }
+    pocadv_mix_ramp_rest(bus, src, frames, channels, gain, step, i / channels);
+}
+
+// The first `n` (1 to 4) floats at `p`, in the low lanes
+POCADV_TARGET("sse2")
+static __m128 pocadv_fx_load_sse2(const float *p, int n) {
+    switch (n) {
+        case 4: return _mm_loadu_ps(p);
+        case 3: return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)p)), _mm_load_ss(p + 2));
+        case 2: return _mm_castpd_ps(_mm_load_sd((const double*)p));
+        default: return _mm_load_ss(p);
+    }
+}
+
+POCADV_TARGET("sse2")
+static void pocadv_fx_store_sse2(float *p, int n, __m128 v) {
+    switch (n) {
+        case 4: _mm_storeu_ps(p, v); break;
+        case 3: _mm_store_sd((double*)p, _mm_castps_pd(v)); _mm_store_ss(p + 2, _mm_movehl_ps(v, v)); break;
+        case 2: _mm_store_sd((double*)p, _mm_castps_pd(v)); break;
+        default: _mm_store_ss(p, v); break;
+    }
+}
+
+// The filter is serial in time, so the lanes hold a frame's channels
+// instead, four at a time: eight channels take two vectors per frame, and
+// the last group of channels may fill only some lanes. z1 and z2 hold
+// POCADV_MAX_CHANNELS floats each, so whole vectors of state fit.
+POCADV_TARGET("sse2")
+static void pocadv_fx_biquad_sse2(float *buf, int frames, int channels, const float *coefs,
+                                  float *z1, float *z2) {
+    if (channels == 1) {
+        pocadv_fx_biquad_scalar(buf, frames, channels, coefs, z1, z2);
+        return;
+    }
+    __m128 b0 = _mm_set1_ps(coefs[0]), b1 = _mm_set1_ps(coefs[1]), b2 = _mm_set1_ps(coefs[2]);
+    __m128 a1 = _mm_set1_ps(coefs[3]), a2 = _mm_set1_ps(coefs[4]);
+    for (int c = 0; c < channels; c += 4) {
+        int lanes = channels - c < 4 ? channels - c : 4;
+        __m128 s1 = _mm_loadu_ps(z1 + c), s2 = _mm_loadu_ps(z2 + c);
+        for (int i = 0; i < frames; i++) {
+            float *f = buf + i * channels + c;
+            __m128 x = pocadv_fx_load_sse2(f, lanes);
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+            s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+            s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            pocadv_fx_store_sse2(f, lanes, y);
+        }
+        _mm_storeu_ps(z1 + c, s1);
+        _mm_storeu_ps(z2 + c, s2);
+    }
+}
+
+// Effect tails decay towards denormals, which are very slow on x86. The
+// mode belongs to the calling thread, so it is returned for restoring.
+POCADV_TARGET("sse2")
+static unsigned int pocadv_fx_flush_denormals() {
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(csr | 0x8040); // flush to zero, denormals are zero
+    return csr;
+}
+
+POCADV_TARGET("sse2")
+static void pocadv_fx_restore_csr(unsigned int csr) {
+    _mm_setcsr(csr);
+}
+
+POCADV_TARGET("avx2")
+static void pocadv_mix_add_avx2(Sint32 *bus, const Sint16 *src, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+        __m256i *b = (__m256i*)(bus + i);
+        _mm256_storeu_si256(b, _mm256_add_epi32(_mm256_loadu_si256(b), lo));
+        _mm256_storeu_si256(b + 1, _mm256_add_epi32(_mm256_loadu_si256(b + 1), hi));
+    }
+    pocadv_mix_add_scalar(bus + i, src + i, n - i);
+}
+
+POCADV_TARGET("avx2")
+static void pocadv_mix_clip_avx2(Sint16 *out, const Sint32 *bus, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(bus + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(bus + i + 8));
+        // packs works per 128-bit lane; put the quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+    pocadv_mix_clip_scalar(out + i, bus + i, n - i);
+}
+
+POCADV_TARGET("avx2")
+static void pocadv_mix_ramp_avx2(Sint32 *bus, const Sint16 *src, int frames, int channels,
+                                 const float *gain, const float *step) {
+    int n = frames * channels, i = 0;
+    if (8 % channels == 0) {
+        float g[8], d[8], t[8];
+        for (int j = 0; j < 8; j++) {
+            g[j] = gain[j % channels];
+            d[j] = step[j % channels];
+            t[j] = (float)(j / channels);
+        }
+        __m256 base = _mm256_loadu_ps(g), slope = _mm256_loadu_ps(d), at = _mm256_loadu_ps(t);
+        __m256 next = _mm256_set1_ps((float)(8 / channels));
+        for (; i + 16 <= n; i += 16) {
+            __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i))));
+            __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8))));
+            lo = _mm256_mul_ps(lo, _mm256_add_ps(base, _mm256_mul_ps(slope, at)));
+            at = _mm256_add_ps(at, next);
+            hi = _mm256_mul_ps(hi, _mm256_add_ps(base, _mm256_mul_ps(slope, at)));
+            at = _mm256_add_ps(at, next);
+            __m256i *b = (__m256i*)(bus + i);
+            _mm256_storeu_si256(b, _mm256_add_epi32(_mm256_loadu_si256(b), _mm256_cvtps_epi32(lo)));
+            _mm256_storeu_si256(b + 1, _mm256_add_epi32(_mm256_loadu_si256(b + 1), _mm256_cvtps_epi32(hi)));
+        }
+        // The compiler doesn't always do this before the call, and SSE code
+        // running with the upper halves dirty is several times slower
+        _mm256_zeroupper();
+    }
+    pocadv_mix_ramp_rest(bus, src, frames, channels, gain, step, i / channels);
+}
+
+#endif // POCADV_X86
+
+// Per-channel gain of a voice where its ramps are now, times a dry or send
+// level. Pan is equal power, scaled up so the centre leaves both sides at
+// full level; with more than two channels it moves the first two.
+static void pocadv_voice_levels(const pocadv_Ramp *gain, const pocadv_Ramp *pan, const pocadv_Ramp *send,
+                                float *level) {
+    int channels = pocadv_device_spec.channels;
+    float g = pocadv_ramp_value(gain) * pocadv_ramp_value(send);
+    for (int c = 0; c < channels; c++) level[c] = g;
+
+    if (channels >= 2) {
+        float angle = (pocadv_ramp_value(pan) + 1.0f) * (float)M_PI / 4.0f;
+        float left = 1.41421356f * SDL_cosf(angle), right = 1.41421356f * SDL_sinf(angle);
+        level[0] *= left < 1.0f ? left : 1.0f;
+        level[1] *= right < 1.0f ? right : 1.0f;
+    }
+}
+
+// Adds frames of a voice to a bus at its levels times `send`. While they
+// glide, the gain ramps linearly across each short segment towards where
+// the levels are at its end. It moves copies of the ramps along, so the
+// voice can go to several buses; pocadv_voice_out moves the voice's own.
+static void pocadv_voice_add(const pocadv_Audio *v, const pocadv_Ramp *send, Sint32 *bus,
+                             const Sint16 *src, int frames) {
+    int channels = pocadv_device_spec.channels;
+    if (pocadv_ramp_at(&v->gain, 1.0f) && pocadv_ramp_at(send, 1.0f) &&
+        (channels == 1 || pocadv_ramp_at(&v->pan, 0.0f))) {
+        pocadv_mix_add(bus, src, frames * channels);
+        return;
+    }
+    if (pocadv_ramp_at(&v->gain, 0.0f) || pocadv_ramp_at(send, 0.0f)) return;
+
+    pocadv_Ramp gain = v->gain, pan = v->pan, level = *send;
+    float from[POCADV_MAX_CHANNELS], to[POCADV_MAX_CHANNELS], step[POCADV_MAX_CHANNELS] = {0};
+    pocadv_voice_levels(&gain, &pan, &level, from);
+    if (gain.pos >= gain.length && pan.pos >= pan.length && level.pos >= level.length) {
+        pocadv_mix_ramp(bus, src, frames, channels, from, step); // levels held steady
+        return;
+    }
+    for (int done = 0; done < frames;) {
+        int n = frames - done < POCADV_MIX_SEGMENT ? frames - done : POCADV_MIX_SEGMENT;
+        pocadv_ramp_advance(&gain, n);
+        pocadv_ramp_advance(&pan, n);
+        pocadv_ramp_advance(&level, n);
+        pocadv_voice_levels(&gain, &pan, &level, to);
+        for (int c = 0; c < channels; c++) step[c] = (to[c] - from[c]) / (float)n;
+        pocadv_mix_ramp(bus + done * channels, src + done * channels, n, channels, from, step);
+        SDL_memcpy(from, to, sizeof(from));
+        done += n;
+    }
+}
+
+// Adds frames of a voice, from frame `done` of the buffer on, to the mix
+// bus and to the effect buses it sends to, and moves its levels on
+static void pocadv_voice_out(pocadv_Audio *v, int done, const Sint16 *src, int frames) {
+    int channels = pocadv_device_spec.channels;
+    pocadv_voice_add(v, &v->dry, pocadv_mix_bus + done * channels, src, frames);
+    for (int b = 0; b < pocadv_fx_count; b++) {
+        if (pocadv_ramp_at(&v->send[b], 0.0f)) continue;
+        pocadv_voice_add(v, &v->send[b], pocadv_fx[b].in + done * channels, src, frames);
+        pocadv_fx[b].fed = 1;
+    }
+
+    pocadv_ramp_advance(&v->gain, frames);
+    pocadv_ramp_advance(&v->pan, frames);
+    pocadv_ramp_advance(&v->dry, frames);
+    for (int b = 0; b < pocadv_fx_count; b++) pocadv_ramp_advance(&v->send[b], frames);
+}
+
+// Both mix into the bus from frame `done` on, where the voice starts
+static void pocadv_voice_mix(pocadv_Audio *v, int done, int frames) {
+    const PocadvSound *s = v->sound;
+    int channels = pocadv_device_spec.channels;
+
+    while (v->playing == 1 && done < frames) {
+        // A repeat still to come cuts this pass short at the loop end,
+        // unless the voice is already past it
+        Uint32 end = s->frames;
+        if (v->loops_remaining != 0 && v->loop_end > v->position && v->loop_end < end) end = v->loop_end;
+
+        Uint32 left = end - v->position;
+        int n = (Uint32)(frames - done) < left ? frames - done : (int)left;
+
+        const Sint16 *src = s->samples + (size_t)v->position * channels;
+        if (s->blocks) {
+            // Carries on from where the voice's decoder stopped, or from the
+            // block's start when it moved to another block or back
+            Uint32 block = v->position / (Uint32)s->block_frames;
+            int offset = (int)(v->position % (Uint32)s->block_frames);
+            if (n > s->block_frames - offset) n = s->block_frames - offset;
+            if (v->ima.block != block || v->ima.frame > offset) v->ima.frame = 0;
+            v->ima.block = block;
+            pocadv_ima_decode(s->blocks + (size_t)block * s->block_size, channels, offset + n, &v->ima, pocadv_mix_blocks);
+            src = pocadv_mix_blocks + offset * channels;
+        }
+
+        pocadv_voice_out(v, done, src, n);
+        v->position += n;
+        done += n;
+
+        // Loops wrap inside the buffer, so there is no gap between them
+        if (v->position >= end) {
+            if (v->loops_remaining == 0) {
+                v->position = 0;
+                v->playing = 0; // Finished
+            } else {
+                v->position = v->loop_start < end ? v->loop_start : 0;
+                if (v->loops_remaining > 0) v->loops_remaining--;
+            }
+        }
+    }
+}
+
+// Takes what the worker has decoded. Running dry only gives silence; the
+// track ends once the worker has queued its last frame and it is played.
+static void pocadv_music_mix(pocadv_Audio *v, int done, int frames) {
+    pocadv_Music *m = v->music;
+    int channels = pocadv_device_spec.channels;
+
+    int finished = SDL_AtomicGet(&m->finished); // before write_pos, which it follows
+    Uint32 read = (Uint32)SDL_AtomicGet(&m->read_pos);
+    Uint32 available = (Uint32)SDL_AtomicGet(&m->write_pos) - read;
+
+    while (done < frames && available > 0) {
+        Uint32 offset = read & (POCADV_MUSIC_RING_FRAMES - 1);
+        Uint32 n = (Uint32)(frames - done);
+        if (n > available) n = available;
+        if (n > POCADV_MUSIC_RING_FRAMES - offset) n = POCADV_MUSIC_RING_FRAMES - offset;
+
+        pocadv_voice_out(v, done, m->ring + (size_t)offset * channels, (int)n);
+        read += n;
+        available -= n;
+        done += (int)n;
+    }
+    SDL_AtomicSet(&m->read_pos, (int)read);
+    SDL_SemPost(m->wake);
+
+    if (finished && available == 0) v->playing = 0;
+}
+
+// Replaces the bus signal with its echoes. The ring is read and rewritten
+// in runs up to its end, and each sample of a run is independent of the
+// others, so the loop vectorises.
+static void pocadv_fx_delay(PocadvFxBus *b, int frames) {
+    int channels = pocadv_device_spec.channels;
+    Uint32 ring = b->delay_frames * channels, pos = b->delay_pos * channels;
+    float *work = b->work;
+
+    for (Uint32 left = (Uint32)(frames * channels); left > 0;) {
+        Uint32 n = ring - pos < left ? ring - pos : left;
+        float *line = b->delay + pos;
+        for (Uint32 i = 0; i < n; i++) {
+            float echo = line[i];
+            line[i] = work[i] + b->feedback * echo;
+            work[i] = echo;
+        }
+        work += n;
+        left -= n;
+        pos = pos + n == ring ? 0 : pos + n;
+    }
+    b->delay_pos = pos / channels;
+}
+
+// Replaces the bus signal with a reverb of it: the channels' sum feeds four
+// delay lines of different lengths, each damped by a one-pole low-pass and
+// fed back through a Hadamard matrix, so the echoes spread without
+// colouring much. Even lines make the left side, odd ones the right.
+// It goes in passes that stop where a line wraps, so every step but the
+// damping works on whole runs and vectorises.
+static void pocadv_fx_reverb(PocadvFxBus *b, int frames) {
+    int channels = pocadv_device_spec.channels;
+    float scale = 1.0f / (float)channels, damping = b->damping, undamped = 1.0f - damping;
+    float in[POCADV_FX_PASS], out[POCADV_FX_LINES][POCADV_FX_PASS], d[POCADV_FX_LINES][POCADV_FX_PASS];
+
+    for (int done = 0; done < frames;) {
+        int n = frames - done < POCADV_FX_PASS ? frames - done : POCADV_FX_PASS;
+        for (int k = 0; k < POCADV_FX_LINES; k++)
+            if (b->line_frames[k] - b->line_pos[k] < (Uint32)n) n = (int)(b->line_frames[k] - b->line_pos[k]);
+
+        float *work = b->work + done * channels;
+        for (int i = 0; i < n; i++) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; c++) sum += work[i * channels + c];
+            in[i] = sum * scale;
+        }
+        for (int k = 0; k < POCADV_FX_LINES; k++)
+            SDL_memcpy(out[k], b->lines[k] + b->line_pos[k], (size_t)n * sizeof(float));
+
+        // The serial part; the four filters run side by side
+        float low0 = b->line_low[0], low1 = b->line_low[1], low2 = b->line_low[2], low3 = b->line_low[3];
+        for (int i = 0; i < n; i++) {
+            low0 = undamped * out[0][i] + damping * low0;
+            low1 = undamped * out[1][i] + damping * low1;
+            low2 = undamped * out[2][i] + damping * low2;
+            low3 = undamped * out[3][i] + damping * low3;
+            d[0][i] = low0;
+            d[1][i] = low1;
+            d[2][i] = low2;
+            d[3][i] = low3;
+        }
+        b->line_low[0] = low0;
+        b->line_low[1] = low1;
+        b->line_low[2] = low2;
+        b->line_low[3] = low3;
+
+        float g0 = 0.5f * b->line_gain[0], g1 = 0.5f * b->line_gain[1];
+        float g2 = 0.5f * b->line_gain[2], g3 = 0.5f * b->line_gain[3];
+        float *line0 = b->lines[0] + b->line_pos[0], *line1 = b->lines[1] + b->line_pos[1];
+        float *line2 = b->lines[2] + b->line_pos[2], *line3 = b->lines[3] + b->line_pos[3];
+        for (int i = 0; i < n; i++) {
+            float d0 = g0 * d[0][i], d1 = g1 * d[1][i], d2 = g2 * d[2][i], d3 = g3 * d[3][i];
+            line0[i] = in[i] + (d0 + d1) + (d2 + d3);
+            line1[i] = in[i] + (d0 - d1) + (d2 - d3);
+            line2[i] = in[i] + (d0 + d1) - (d2 + d3);
+            line3[i] = in[i] + (d0 - d1) - (d2 - d3);
+        }
+
+        if (channels == 1) {
+            for (int i = 0; i < n; i++) work[i] = 0.5f * (out[0][i] + out[1][i] + out[2][i] + out[3][i]);
+        } else {
+            for (int i = 0; i < n; i++) {
+                for (int c = 0; c < channels; c++)
+                    work[i * channels + c] = c & 1 ? out[1][i] + out[3][i] : out[0][i] + out[2][i];
+            }
+        }
+
+        for (int k = 0; k < POCADV_FX_LINES; k++) {
+            b->line_pos[k] += (Uint32)n;
+            if (b->line_pos[k] == b->line_frames[k]) b->line_pos[k] = 0;
+        }
+        done += n;
+    }
+}
+
+// Whether a filter still rings from earlier input, by at least half a sample
+static int pocadv_fx_ringing(const PocadvFxBus *b) {
+    if (b->filter == POCADV_FILTER_NONE) return 0;
+    for (int c = 0; c < pocadv_device_spec.channels; c++) {
+        if (SDL_fabsf(b->state[0][c]) >= 0.5f || SDL_fabsf(b->state[1][c]) >= 0.5f) return 1;
+    }
+    return 0;
+}
+
+// Runs what was sent to a bus through its effects and adds the result to
+// the mix bus. A bus nothing was sent to still runs while a delay, reverb
+// or filter may have a tail.
+static void pocadv_fx_run(PocadvFxBus *b, int frames) {
+    int channels = pocadv_device_spec.channels, n = frames * channels;
+    if (!b->fed && b->delay_frames == 0 && b->line_gain[0] == 0.0f && !pocadv_fx_ringing(b)) {
+        // The filter's last half-sample of tail is dropped, so the next
+        // send starts from rest instead of from stale history
+        SDL_memset(b->state, 0, sizeof(b->state));
+        return;
+    }
+
+    if (b->fed) {
+        for (int i = 0; i < n; i++) b->work[i] = (float)b->in[i];
+        SDL_memset(b->in, 0, (size_t)n * sizeof(Sint32));
+        b->fed = 0;
+    } else {
+        SDL_memset(b->work, 0, (size_t)n * sizeof(float));
+    }
+
+    if (b->filter != POCADV_FILTER_NONE) pocadv_fx_biquad(b->work, frames, channels, b->coefs, b->state[0], b->state[1]);
+    if (b->delay_frames > 0) pocadv_fx_delay(b, frames);
+    if (b->line_gain[0] > 0.0f) pocadv_fx_reverb(b, frames);
+
+    float ret = b->ret, step = (b->ret_target - b->ret) / (float)frames;
+    b->ret = b->ret_target;
+    if (ret == 0.0f && step == 0.0f) return;
+    for (int i = 0; i < frames; i++, ret += step) {
+        for (int c = 0; c < channels; c++) {
+            pocadv_mix_bus[i * channels + c] += pocadv_mix_round(b->work[i * channels + c] * ret);
+        }
+    }
+}
+
+// Sums every playing voice into the bus, then saturates once into `out`.
+// A voice scheduled for later starts partway in, or waits for a later buffer.
+static void pocadv_audio_mix(Sint16 *out, int frames) {
+    int channels = pocadv_device_spec.channels;
+    SDL_memset(pocadv_mix_bus, 0, (size_t)frames * channels * sizeof(Sint32));
+
+    int i = 0;
+    while (i < pocadv_voice_count) {
+        pocadv_Audio *v = pocadv_voices[i];
+        if (v->playing == 1 && v->start < pocadv_mix_clock + (Uint64)frames) {
+            int offset = v->start > pocadv_mix_clock ? (int)(v->start - pocadv_mix_clock) : 0;
+            if (v->music) pocadv_music_mix(v, offset, frames);
+            else pocadv_voice_mix(v, offset, frames);
+        }
+
+        if (v->playing == 0)
+            pocadv_voices[i] = pocadv_voices[--pocadv_voice_count];
+        else
+            i++;
+    }
+
+    for (int b = 0; b < pocadv_fx_count; b++) pocadv_fx_run(&pocadv_fx[b], frames);
+
+    pocadv_mix_clip(out, pocadv_mix_bus, frames * channels);
+    pocadv_mix_clock += (Uint64)frames;
+}
+
+static void pocadv_audio_callback(void *userdata, Uint8 *stream, int len) {
+    (void)userdata;
+    int channels = pocadv_device_spec.channels;
+    int frames = len / (int)(channels * sizeof(Sint16));
+    Sint16 *out = (Sint16*)stream;
+
+#ifdef POCADV_X86
+    int flush = pocadv_fx_count > 0 && SDL_HasSSE2();
+    unsigned int csr = flush ? pocadv_fx_flush_denormals() : 0;
+#endif
+    pocadv_audio_drain();
+
+    // SDL may ask for more than the spec's buffer size; mix it in pieces
+    for (int done = 0; done < frames; done += pocadv_mix_bus_frames) {
+        int n = frames - done < pocadv_mix_bus_frames ? frames - done : pocadv_mix_bus_frames;
+        pocadv_audio_mix(out + done * channels, n);
+    }
+
+    SDL_AtomicAdd(&pocadv_mix_seq, 1);
+    pocadv_mix_counter = SDL_GetPerformanceCounter();
+    pocadv_mix_frames = frames;
+    pocadv_mix_clock_end = pocadv_mix_clock;
+    SDL_AtomicAdd(&pocadv_mix_seq, 1);
+#ifdef POCADV_X86
+    if (flush) pocadv_fx_restore_csr(csr);
+#endif
+}
+
+// Allocates every buffer the effect buses use, once the device format is
+// known; returns -1 if one can't be
+static int pocadv_fx_open(int count) {
+    // Reverb line lengths at 44100 Hz; primes, so their echoes rarely line up
+    static const Uint32 lines[POCADV_FX_LINES] = {1087, 1283, 1447, 1663};
+    int channels = pocadv_device_spec.channels, freq = pocadv_device_spec.freq;
+
+    pocadv_fx_count = count < 0 ? 0 : count > POCADV_MAX_BUSES ? POCADV_MAX_BUSES : count;
+    for (int i = 0; i < pocadv_fx_count; i++) {
+        PocadvFxBus *b = &pocadv_fx[i];
+        b->in = (Sint32*)calloc((size_t)pocadv_mix_bus_frames * channels, sizeof(Sint32));
+        b->work = (float*)malloc((size_t)pocadv_mix_bus_frames * channels * sizeof(float));
+        b->delay_capacity = (Uint32)(POCADV_FX_MAX_DELAY * freq);
+        b->delay = (float*)calloc((size_t)b->delay_capacity * channels, sizeof(float));
+        if (!b->in || !b->work || !b->delay) return -1;
+
+        for (int k = 0; k < POCADV_FX_LINES; k++) {
+            b->line_frames[k] = (Uint32)((Uint64)lines[k] * freq / 44100);
+            b->lines[k] = (float*)calloc(b->line_frames[k], sizeof(float));
+            if (!b->lines[k]) return -1;
+        }
+        b->ret = b->ret_target = 1.0f;
+    }
+    return 0;
+}
+
+static void pocadv_fx_close() {
+    for (int i = 0; i < POCADV_MAX_BUSES; i++) {
+        PocadvFxBus *b = &pocadv_fx[i];
+        free(b->in);
+        free(b->work);
+        free(b->delay);
+        for (int k = 0; k < POCADV_FX_LINES; k++) free(b->lines[k]);
+    }
+    SDL_memset(pocadv_fx, 0, sizeof(pocadv_fx));
+    pocadv_fx_count = 0;
+}
+
+static void pocadv_audio_open(const pocadv_Options *opts) {
+    // 16-bit at the requested rate, channels and buffer size; SDL converts
+    // if the hardware differs
+    SDL_zero(pocadv_device_spec);
+    pocadv_device_spec.freq = opts->audio_freq > 0 ? opts->audio_freq : 44100;
+    pocadv_device_spec.format = AUDIO_S16SYS;
+    int channels = opts->audio_channels > 0 ? opts->audio_channels : 2;
+    int samples = 1024;
+    if (opts->audio_samples > 0) {
+        for (samples = 1; samples < opts->audio_samples && samples < 32768; samples *= 2) {}
+    }
+    pocadv_device_spec.channels = (Uint8)(channels < POCADV_MAX_CHANNELS ? channels : POCADV_MAX_CHANNELS);
+    pocadv_device_spec.samples = (Uint16)samples;
+    pocadv_device_spec.callback = pocadv_audio_callback;
+    pocadv_device_spec.userdata = NULL;
+
+    SDL_AtomicSet(&pocadv_audio_queue_head, 0);
+    SDL_AtomicSet(&pocadv_audio_queue_tail, 0);
+
+    pocadv_mix_bus_frames = pocadv_device_spec.samples;
+    pocadv_mix_bus = (Sint32*)malloc((size_t)pocadv_mix_bus_frames * pocadv_device_spec.channels * sizeof(Sint32));
+    if (!pocadv_mix_bus) return;
+    if (pocadv_audio_adpcm) {
+        pocadv_ima_init();
+        pocadv_mix_blocks = (Sint16*)malloc((size_t)POCADV_ADPCM_MAX_FRAMES * pocadv_device_spec.channels * sizeof(Sint16));
+        if (!pocadv_mix_blocks) return;
+    }
+    if (pocadv_fx_open(opts->audio_buses) < 0) return;
+
+    // The pooled voices always have room in the mixer's list
+    SDL_memset(pocadv_voice_pool, 0, sizeof(pocadv_voice_pool));
+    if (pocadv_reserve((void**)&pocadv_voices, &pocadv_voice_capacity,
+                       POCADV_MAX_VOICES, sizeof(pocadv_Audio*)) < 0) return;
+    pocadv_voice_total = POCADV_MAX_VOICES;
+
+    pocadv_mix_add = pocadv_mix_add_scalar;
+    pocadv_mix_clip = pocadv_mix_clip_scalar;
+    pocadv_mix_ramp = pocadv_mix_ramp_scalar;
+    pocadv_fx_biquad = pocadv_fx_biquad_scalar;
+#ifdef POCADV_X86
+    if (SDL_HasAVX2()) {
+        pocadv_mix_add = pocadv_mix_add_avx2;
+        pocadv_mix_clip = pocadv_mix_clip_avx2;
+        pocadv_mix_ramp = pocadv_mix_ramp_avx2;
+    } else if (SDL_HasSSE2()) {
+        pocadv_mix_add = pocadv_mix_add_sse2;
+        pocadv_mix_clip = pocadv_mix_clip_sse2;
+        pocadv_mix_ramp = pocadv_mix_ramp_sse2;
+    }
+    if (SDL_HasSSE2()) pocadv_fx_biquad = pocadv_fx_biquad_sse2;
+#endif
+
+    pocadv_mix_counter = SDL_GetPerformanceCounter();
+    pocadv_mix_frames = 0;
+    pocadv_mix_clock = pocadv_mix_clock_end = 0;
+
+    pocadv_audio_device = SDL_OpenAudioDevice(NULL, 0, &pocadv_device_spec, NULL, 0);
+    if (pocadv_audio_device != 0) SDL_PauseAudioDevice(pocadv_audio_device, 0);
+}
+
+// Reads what the callback last published; retries if it overlapped a write
+static void pocadv_mix_read(Uint64 *counter, int *frames, Uint64 *clock) {
+    int seq;
+    do {
+        seq = SDL_AtomicGet(&pocadv_mix_seq);
+        *counter = pocadv_mix_counter;
+        *frames = pocadv_mix_frames;
+        *clock = pocadv_mix_clock_end;
+        SDL_MemoryBarrierAcquire();
+    } while ((seq & 1) || SDL_AtomicGet(&pocadv_mix_seq) != seq);
+}
+
+Uint64 pocadv_audio_get_clock() {
+    Uint64 counter, clock;
+    int frames;
+    pocadv_mix_read(&counter, &frames, &clock);
+    return clock;
+}
+
+// The device is taken to be playing one buffer while the mixer fills the
+// next, so right after a callback a buffer plus what it mixed is waiting.
+// That drains in real time until the next callback.
+double pocadv_audio_get_latency(int *queued_frames) {
+    if (queued_frames) *queued_frames = 0;
+    if (pocadv_audio_device == 0) return -1.0;
+
+    Uint64 counter, clock;
+    int frames;
+    pocadv_mix_read(&counter, &frames, &clock);
+    Uint64 since = SDL_GetPerformanceCounter() - counter;
+
+    double played = (double)since * pocadv_device_spec.freq / (double)SDL_GetPerformanceFrequency();
+    double queued = pocadv_device_spec.samples + frames - played;
+    if (queued < 0.0) queued = 0.0;
+
+    if (queued_frames) *queued_frames = (int)queued;
+    return queued / pocadv_device_spec.freq;
+}
+
+static void pocadv_audio_close() {
+    if (pocadv_audio_device != 0) SDL_CloseAudioDevice(pocadv_audio_device);
+    pocadv_audio_device = 0;
+
+    // Requests nobody will apply any more
+    SDL_AtomicSet(&pocadv_audio_queue_tail, SDL_AtomicGet(&pocadv_audio_queue_head));
+
+    pocadv_free_all_audio();
+    free(pocadv_voices);
+    pocadv_voices = NULL;
+    pocadv_voice_count = 0;
+    pocadv_voice_capacity = 0;
+    pocadv_voice_total = 0;
+
+    free(pocadv_mix_bus);
+    pocadv_mix_bus = NULL;
+    pocadv_mix_bus_frames = 0;
+    free(pocadv_mix_blocks);
+    pocadv_mix_blocks = NULL;
+    pocadv_fx_close();
+}
+
+// Converts a buffer from SDL_LoadWAV to the device format. The result
+// replaces the original and is freed with SDL_FreeWAV as well.
+static int pocadv_convert_audio(const SDL_AudioSpec *spec, Uint8 **buffer, Uint32 *length) {
+    SDL_AudioCVT cvt;
+    int needed = SDL_BuildAudioCVT(&cvt, spec->format, spec->channels, spec->freq,
+                                   pocadv_device_spec.format, pocadv_device_spec.channels,
+                                   pocadv_device_spec.freq);
+    if (needed <= 0) return needed;
+
+    cvt.len = (int)*length;
+    cvt.buf = (Uint8*)SDL_malloc((size_t)*length * cvt.len_mult);
+    if (!cvt.buf) return -1;
+    memcpy(cvt.buf, *buffer, *length);
+    if (SDL_ConvertAudio(&cvt) < 0) {
+        SDL_free(cvt.buf);
+        return -1;
+    }
+
+    SDL_FreeWAV(*buffer);
+    *buffer = cvt.buf;
+    *length = (Uint32)cvt.len_cvt;
+    return 0;
+}
+
+// Decodes an MP3, or a WAV encoding only SDL_LoadWAV knows, into a buffer
+// freed with SDL_FreeWAV
+static int pocadv_load_compressed(SDL_RWops *rw, SDL_AudioSpec *spec, Uint8 **buffer, Uint32 *length) {
+    PocadvMp3 *mp3 = pocadv_mp3_open(rw);
+    if (!mp3) {
+        if (SDL_RWseek(rw, 0, RW_SEEK_SET) < 0) return -1;
+        return SDL_LoadWAV_RW(rw, 0, spec, buffer, length) ? 0 : -1;
+    }
+
+    int result = pocadv_mp3_load(mp3, spec, buffer, length);
+    pocadv_mp3_close(mp3);
+    return result;
+}
+
+// Reads WAV sample data straight into the buffer it is converted in, so it
+// is copied once
+static int pocadv_wav_read(SDL_RWops *rw, const SDL_AudioSpec *spec, Sint64 data_size, Uint8 **buffer, Uint32 *length) {
+    SDL_AudioCVT cvt;
+    int needed = SDL_BuildAudioCVT(&cvt, spec->format, spec->channels, spec->freq,
+                                   pocadv_device_spec.format, pocadv_device_spec.channels,
+                                   pocadv_device_spec.freq);
+    if (needed < 0 || data_size > SDL_MAX_SINT32 / cvt.len_mult) return -1;
+
+    cvt.len = (int)data_size;
+    cvt.buf = (Uint8*)SDL_malloc((size_t)cvt.len * cvt.len_mult);
+    if (!cvt.buf) return -1;
+    if (SDL_RWread(rw, cvt.buf, 1, (size_t)cvt.len) != (size_t)cvt.len || (needed && SDL_ConvertAudio(&cvt) < 0)) {
+        SDL_free(cvt.buf);
+        return -1;
+    }
+
+    *buffer = cvt.buf;
+    *length = (Uint32)(needed ? cvt.len_cvt : cvt.len);
+    return 0;
+}
+
+#ifdef POCADV_MMAP
+// Maps a WAV whose samples are already in the device format. The mixer
+// reads the page cache directly and the OS pages samples in as they play.
+static int pocadv_wav_map(const char *file, Sint64 data_start, Sint64 data_size, PocadvSound *s) {
+    if (data_start % sizeof(Sint16) != 0) return -1;
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return -1;
+
+    size_t size = (size_t)(data_start + data_size);
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+
+    s->mapping = base;
+    s->mapping_size = size;
+    s->samples = (Sint16*)((Uint8*)base + data_start);
+    return 0;
+}
+
+static void pocadv_wav_unmap(PocadvSound *s) {
+    munmap(s->mapping, s->mapping_size);
+}
+#else
+static int pocadv_wav_map(const char *file, Sint64 data_start, Sint64 data_size, PocadvSound *s) {
+    (void)file;
+    (void)data_start;
+    (void)data_size;
+    (void)s;
+    return -1;
+}
+
+static void pocadv_wav_unmap(PocadvSound *s) {
+    (void)s;
+}
+#endif
+
+// Converted sounds cache. Changing how files are decoded or converted must
+// bump the version, which is part of every entry's name.
+#define POCADV_AUDIO_CACHE_VERSION 1
+
+// Names the cache entry for a source file: a hash of its contents and the
+// device format. Returns a malloc'd path, or NULL with no cache. Entries
+// are little-endian WAVs, so big-endian devices go without.
+static char* pocadv_cache_path(SDL_RWops *rw) {
+    if (!pocadv_audio_cache || pocadv_device_spec.format != AUDIO_S16LSB) return NULL;
+    if (SDL_RWseek(rw, 0, RW_SEEK_SET) < 0) return NULL;
+
+    // FNV-1a over the whole file
+    Uint64 hash = 14695981039346656037ull;
+    Uint8 chunk[16384];
+    size_t got;
+    while ((got = SDL_RWread(rw, chunk, 1, sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            hash ^= chunk[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    size_t n = strlen(pocadv_audio_cache);
+    int slash = n > 0 && pocadv_audio_cache[n - 1] != '/' && pocadv_audio_cache[n - 1] != '\\';
+    char *path = (char*)malloc(n + 64);
+    if (path) {
+        SDL_snprintf(path, n + 64, "%s%s%016llx-%d-%d-v%d.wav", pocadv_audio_cache, slash ? "/" : "",
+                     (unsigned long long)hash, pocadv_device_spec.freq, pocadv_device_spec.channels,
+                     POCADV_AUDIO_CACHE_VERSION);
+    }
+    return path;
+}
+
+// Loads a cache entry: a WAV in the device format, mapped when possible
+static int pocadv_cache_load(PocadvSound *s, const char *path) {
+    SDL_RWops *rw = SDL_RWFromFile(path, "rb");
+    if (!rw) return -1;
+
+    SDL_AudioSpec spec;
+    Sint64 data_start, data_size;
+    int frame_size, result = -1;
+    if (pocadv_wav_open(rw, &spec, &data_start, &data_size, &frame_size, NULL) == 0 &&
+        spec.format == pocadv_device_spec.format && spec.channels == pocadv_device_spec.channels &&
+        spec.freq == pocadv_device_spec.freq) {
+        Uint8 *buffer = NULL;
+        Uint32 length = 0;
+        if (pocadv_wav_map(path, data_start, data_size, s) == 0) {
+            s->frames = (Uint32)(data_size / frame_size);
+            result = 0;
+        } else if (pocadv_wav_read(rw, &spec, data_size, &buffer, &length) == 0) {
+            s->samples = (Sint16*)buffer;
+            s->frames = length / frame_size;
+            result = 0;
+        }
+    }
+    SDL_RWclose(rw);
+    return result;
+}
+
+// Saves converted samples as a cache entry. They are written under a
+// temporary name and renamed into place, so a reader never sees half a file.
+static void pocadv_cache_store(const char *path, const PocadvSound *s) {
+    Uint32 bytes = s->frames * pocadv_device_spec.channels * (Uint32)sizeof(Sint16);
+    Uint8 header[44];
+    memcpy(header, "RIFF", 4);
+    pocadv_write_le32(header + 4, 36 + bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    pocadv_write_le32(header + 16, 16);
+    pocadv_write_le16(header + 20, 1); // PCM
+    pocadv_write_le16(header + 22, pocadv_device_spec.channels);
+    pocadv_write_le32(header + 24, (Uint32)pocadv_device_spec.freq);
+    pocadv_write_le32(header + 28, (Uint32)pocadv_device_spec.freq * pocadv_device_spec.channels * sizeof(Sint16));
+    pocadv_write_le16(header + 32, (Uint16)(pocadv_device_spec.channels * sizeof(Sint16)));
+    pocadv_write_le16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    pocadv_write_le32(header + 40, bytes);
+
+    size_t n = strlen(path);
+    char *temp = (char*)malloc(n + 5);
+    if (!temp) return;
+    memcpy(temp, path, n);
+    memcpy(temp + n, ".tmp", 5);
+
+    SDL_RWops *rw = SDL_RWFromFile(temp, "wb");
+    if (rw) {
+        int ok = SDL_RWwrite(rw, header, 1, sizeof(header)) == sizeof(header) &&
+                 SDL_RWwrite(rw, s->samples, 1, bytes) == bytes;
+        if (SDL_RWclose(rw) == 0 && ok && rename(temp, path) == 0) temp[0] = '\0';
+        if (temp[0]) remove(temp);
+    }
+    free(temp);
+}
+
+// Fills in a sound's samples, in the device format
+static int pocadv_sound_load(PocadvSound *s, const char *file) {
+    SDL_RWops *rw = SDL_RWFromFile(file, "rb");
+    if (!rw) return -1;
+
+    SDL_AudioSpec spec;
+    Sint64 data_start, data_size;
+    int frame_size;
+    Uint8 *buffer = NULL;
+    Uint32 length = 0, fact_length;
+    int result;
+    // A WAV already in the device format is used as it is
+    int is_wav = pocadv_wav_open(rw, &spec, &data_start, &data_size, &frame_size, &fact_length) == 0;
+    if (is_wav && spec.format == 0) {
+        if (pocadv_audio_adpcm && spec.channels == pocadv_device_spec.channels &&
+            spec.freq == pocadv_device_spec.freq && spec.samples <= POCADV_ADPCM_MAX_FRAMES) {
+            result = pocadv_wav_map(file, data_start, data_size, s);
+            if (result == 0) {
+                s->blocks = (Uint8*)s->samples;
+                s->samples = NULL;
+            } else if ((s->blocks = (Uint8*)SDL_malloc((size_t)data_size)) != NULL) {
+                result = SDL_RWread(rw, s->blocks, 1, (size_t)data_size) == (size_t)data_size ? 0 : -1;
+            }
+            SDL_RWclose(rw);
+            s->block_size = frame_size;
+            s->block_frames = spec.samples;
+            s->frames = (Uint32)(data_size / frame_size) * spec.samples;
+            if (fact_length > 0 && fact_length < s->frames) s->frames = fact_length;
+            return result;
+        }
+        is_wav = 0; // SDL_LoadWAV decodes it
+    }
+    if (is_wav && spec.format == pocadv_device_spec.format && spec.channels == pocadv_device_spec.channels &&
+        spec.freq == pocadv_device_spec.freq && pocadv_wav_map(file, data_start, data_size, s) == 0) {
+        SDL_RWclose(rw);
+        s->frames = (Uint32)(data_size / frame_size);
+        return 0;
+    }
+
+    // Anything else is converted, unless an earlier run already did it
+    char *cached = pocadv_cache_path(rw);
+    if (cached && pocadv_cache_load(s, cached) == 0) {
+        free(cached);
+        SDL_RWclose(rw);
+        return 0;
+    }
+
+    if (is_wav) {
+        result = SDL_RWseek(rw, data_start, RW_SEEK_SET) < 0 ? -1 : pocadv_wav_read(rw, &spec, data_size, &buffer, &length);
+    } else {
+        result = SDL_RWseek(rw, 0, RW_SEEK_SET) < 0 ? -1 : pocadv_load_compressed(rw, &spec, &buffer, &length);
+        if (result == 0 && pocadv_convert_audio(&spec, &buffer, &length) < 0) {
+            SDL_FreeWAV(buffer);
+            result = -1;
+        }
+    }
+    SDL_RWclose(rw);
+    if (result == 0) {
+        s->samples = (Sint16*)buffer;
+        s->frames = length / (pocadv_device_spec.channels * sizeof(Sint16));
+        if (cached && s->frames > 0) pocadv_cache_store(cached, s);
+    }
+    free(cached);
+    return result;
+}
+
+// Finds the loudest sample, decoding IMA ADPCM a block at a time
+static void pocadv_sound_peak(PocadvSound *s) {
+    int channels = pocadv_device_spec.channels;
+    if (!s->blocks) {
+        for (Uint32 i = 0; i < s->frames * channels; i++) {
+            int v = abs(s->samples[i]);
+            if (v > s->peak) s->peak = v;
+        }
+        return;
+    }
+
+    Sint16 *block = (Sint16*)malloc((size_t)s->block_frames * channels * sizeof(Sint16));
+    if (!block) return;
+    for (Uint32 first = 0; first < s->frames; first += (Uint32)s->block_frames) {
+        int frames = s->frames - first < (Uint32)s->block_frames ? (int)(s->frames - first) : s->block_frames;
+        pocadv_ImaState st;
+        SDL_zero(st);
+        pocadv_ima_decode(s->blocks + (size_t)(first / s->block_frames) * s->block_size, channels,
+                          frames, &st, block);
+        for (int i = 0; i < frames * channels; i++) {
+            int v = abs(block[i]);
+            if (v > s->peak) s->peak = v;
+        }
+    }
+    free(block);
+}
+
+// Replaces a sound's samples with IMA ADPCM blocks; it keeps the samples
+// if they can't be encoded
+static void pocadv_sound_compress(PocadvSound *s) {
+    int channels = pocadv_device_spec.channels;
+    Uint32 size;
+    Uint8 *blocks = pocadv_ima_encode(s->samples, s->frames, channels, &size);
+    if (!blocks) return;
+
+    if (s->mapping) pocadv_wav_unmap(s);
+    else SDL_FreeWAV((Uint8*)s->samples);
+    s->mapping = NULL;
+    s->samples = NULL;
+    s->blocks = blocks;
+    s->block_size = POCADV_ADPCM_BLOCK * channels;
+    s->block_frames = pocadv_ima_block_frames(s->block_size, channels);
+}
+
+static void pocadv_sound_free(PocadvSound *s) {
+    if (s->mapping) {
+        pocadv_wav_unmap(s);
+    } else {
+        SDL_FreeWAV((Uint8*)s->samples);
+        SDL_free(s->blocks);
+    }
+    free(s->path);
+    free(s);
+}
+
+// Makes room in the mixer's list for one more voice
+static int pocadv_voice_reserve() {
+    pocadv_audio_lock();
+    int result = pocadv_reserve((void**)&pocadv_voices, &pocadv_voice_capacity,
+                                pocadv_voice_total + 1, sizeof(pocadv_Audio*));
+    if (result == 0) pocadv_voice_total++;
+    pocadv_audio_unlock();
+    return result;
+}
+
+// Takes a voice out of the mixer for good, before it is freed
+static void pocadv_voice_release(pocadv_Audio *v) {
+    pocadv_audio_lock();
+    pocadv_audio_drain(); // no queued request may still point at it
+    pocadv_voice_remove(v);
+    pocadv_voice_total--;
+    pocadv_audio_unlock();
+}
+
+// Returns the ID of a loaded sound, sharing an existing copy of the file
+// when there is one, or -1
+static int pocadv_sound_acquire(const char *file) {
+    if (!file || pocadv_audio_device == 0) return -1;
+
+    Uint32 hash = pocadv_hash_string(file);
+    int free_slot = -1;
+    for (int i = 0; i < pocadv_sound_count; i++) {
+        PocadvSound *s = pocadv_sounds[i];
+        if (!s) {
+            if (free_slot < 0) free_slot = i;
+            continue;
+        }
+        if (s->hash == hash && strcmp(s->path, file) == 0) {
+            s->refs++;
+            return i;
+        }
+    }
+
+    PocadvSound *s = (PocadvSound*)calloc(1, sizeof(PocadvSound));
+    if (!s) return -1;
+    s->path = (char*)malloc(strlen(file) + 1);
+    if (!s->path || pocadv_sound_load(s, file) < 0 || s->frames == 0 ||
+        (free_slot < 0 && pocadv_reserve((void**)&pocadv_sounds, &pocadv_sound_capacity,
+                                         pocadv_sound_count + 1, sizeof(PocadvSound*)) < 0)) {
+        pocadv_sound_free(s);
+        return -1;
+    }
+    strcpy(s->path, file);
+
+    s->hash = hash;
+    s->refs = 1;
+    s->gain = 1.0f;
+    s->dry = 1.0f;
+
+    // Only this policy needs the peak; skipping the scan leaves mapped
+    // samples unread until they play
+    if (pocadv_voice_steal == POCADV_STEAL_QUIETEST) pocadv_sound_peak(s);
+    if (pocadv_audio_adpcm && s->samples) pocadv_sound_compress(s);
+
+    int id = free_slot >= 0 ? free_slot : pocadv_sound_count++;
+    pocadv_sounds[id] = s;
+    return id;
+}
+
+static PocadvSound* pocadv_sound_get(int sound_id) {
+    if (sound_id < 0 || sound_id >= pocadv_sound_count) return NULL;
+    return pocadv_sounds[sound_id];
+}
+
+static void pocadv_sound_release(PocadvSound *s) {
+    int id = -1;
+    for (int i = 0; i < pocadv_sound_count; i++) {
+        if (pocadv_sounds[i] == s) id = i;
+    }
+    if (id < 0 || --s->refs > 0) return; // already freed, or still in use
+
+    // Stop the pooled voices still playing it
+    pocadv_audio_lock();
+    pocadv_audio_drain();
+    for (int i = 0; i < POCADV_MAX_VOICES; i++) {
+        if (pocadv_voice_pool[i].sound == s) {
+            pocadv_voice_remove(&pocadv_voice_pool[i]);
+            pocadv_voice_pool[i].sound = NULL;
+        }
+    }
+    pocadv_audio_unlock();
+
+    pocadv_sounds[id] = NULL;
+    pocadv_sound_free(s);
+}
+
+int pocadv_load_wav(const char *file) {
+    return pocadv_sound_acquire(file);
+}
+
+void pocadv_play_sound(int sound_id) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_sound(POCADV_AUDIO_PLAY, s);
+}
+
+void pocadv_play_sound_at(int sound_id, Uint64 clock) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (!s) return;
+
+    PocadvAudioCmd cmd = {POCADV_AUDIO_PLAY, NULL, s, 0, s->max_instances, s->gain, s->pan, 0.0f, 0, clock, 0, 0, 0};
+    pocadv_audio_send(&cmd);
+}
+
+void pocadv_pause_sound(int sound_id) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_sound(POCADV_AUDIO_PAUSE, s);
+}
+
+void pocadv_unpause_sound(int sound_id) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_sound(POCADV_AUDIO_UNPAUSE, s);
+}
+
+void pocadv_stop_sound(int sound_id) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_sound(POCADV_AUDIO_STOP, s);
+}
+
+void pocadv_set_sound_limit(int sound_id, int max_instances) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) s->max_instances = max_instances > 0 ? max_instances : 0;
+}
+
+void pocadv_set_sound_gain(int sound_id, float gain) {
+    pocadv_fade_sound(sound_id, gain, 0.0f, POCADV_FADE_LINEAR);
+}
+
+void pocadv_set_sound_pan(int sound_id, float pan) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_level(POCADV_AUDIO_PAN, NULL, s, pan, 0.0f, POCADV_FADE_LINEAR);
+}
+
+void pocadv_fade_sound(int sound_id, float gain, float seconds, pocadv_Fade curve) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_level(POCADV_AUDIO_GAIN, NULL, s, gain, seconds, curve);
+}
+
+void pocadv_free_all_audio() {
+    pocadv_audio_lock();
+    pocadv_audio_drain();
+    for (int i = 0; i < pocadv_voice_count; i++) {
+        pocadv_voices[i]->playing = 0;
+        pocadv_voices[i]->position = 0;
+    }
+    pocadv_voice_count = 0;
+    pocadv_audio_unlock();
+
+    for (int i = 0; i < pocadv_sound_count; i++) {
+        PocadvSound *s = pocadv_sounds[i];
+        if (s) pocadv_sound_free(s);
+    }
+    SDL_memset(pocadv_voice_pool, 0, sizeof(pocadv_voice_pool));
+    free(pocadv_sounds);
+    pocadv_sounds = NULL;
+    pocadv_sound_count = 0;
+    pocadv_sound_capacity = 0;
+}
+
+pocadv_Audio* pocadv_audio_load(const char *file) {
+    int id = pocadv_sound_acquire(file);
+    if (id < 0) return NULL;
+
+    pocadv_Audio *audio = (pocadv_Audio*)calloc(1, sizeof(pocadv_Audio));
+    if (!audio || pocadv_voice_reserve() < 0) {
+        free(audio);
+        pocadv_sound_release(pocadv_sounds[id]);
+        return NULL;
+    }
+    audio->sound = pocadv_sounds[id];
+    pocadv_ramp_set(&audio->gain, 1.0f);
+    pocadv_ramp_set(&audio->dry, 1.0f);
+    return audio;
+}
+
+int pocadv_audio_play(pocadv_Audio *audio, int loop_count) {
+    return pocadv_audio_play_at(audio, loop_count, 0);
+}
+
+int pocadv_audio_play_at(pocadv_Audio *audio, int loop_count, Uint64 clock) {
+    if (!audio || !audio->sound || pocadv_audio_device == 0) return -1;
+
+    PocadvAudioCmd cmd = {POCADV_AUDIO_PLAY, audio, NULL, loop_count == 0 ? -1 : loop_count - 1,
+                          0, 0.0f, 0.0f, 0.0f, 0, clock, 0, 0, 0};
+    pocadv_audio_send(&cmd);
+    return 0;
+}
+
+void pocadv_audio_set_loop(pocadv_Audio *audio, double start, double end) {
+    if (!audio || !audio->sound || pocadv_audio_device == 0) return;
+    int freq = pocadv_device_spec.freq;
+    Uint32 loop_start = start > 0.0 ? (Uint32)(start * freq + 0.5) : 0;
+    Uint32 loop_end = end > 0.0 ? (Uint32)(end * freq + 0.5) : 0;
+
+    PocadvAudioCmd cmd = {POCADV_AUDIO_LOOP, audio, NULL, 0, 0, 0.0f, 0.0f, 0.0f, 0, 0, loop_start, loop_end, 0};
+    pocadv_audio_send(&cmd);
+}
+
+void pocadv_audio_stop(pocadv_Audio *audio) {
+    if (audio) pocadv_audio_push(POCADV_AUDIO_STOP, audio, 0);
+}
+
+void pocadv_audio_pause(pocadv_Audio *audio) {
+    if (audio) pocadv_audio_push(POCADV_AUDIO_PAUSE, audio, 0);
+}
+
+void pocadv_audio_unpause(pocadv_Audio *audio) {
+    if (audio) pocadv_audio_push(POCADV_AUDIO_UNPAUSE, audio, 0);
+}
+
+void pocadv_audio_free(pocadv_Audio *audio) {
+    if (!audio) return;
+
+    pocadv_voice_release(audio);
+    if (audio->sound) pocadv_sound_release(audio->sound);
+    free(audio);
+}
+
+void pocadv_audio_set_gain(pocadv_Audio *audio, float gain) {
+    pocadv_audio_fade(audio, gain, 0.0f, POCADV_FADE_LINEAR);
+}
+
+void pocadv_audio_set_pan(pocadv_Audio *audio, float pan) {
+    if (audio) pocadv_audio_push_level(POCADV_AUDIO_PAN, audio, NULL, pan, 0.0f, POCADV_FADE_LINEAR);
+}
+
+void pocadv_audio_fade(pocadv_Audio *audio, float gain, float seconds, pocadv_Fade curve) {
+    if (audio) pocadv_audio_push_level(POCADV_AUDIO_GAIN, audio, NULL, gain, seconds, curve);
+}
+
+// ----------------------- Music ----------------------
+
+// Reads the next chunk of the file's samples into m->chunk, decoding an MP3.
+// Returns its size in bytes, 0 at the end of the data.
+static int pocadv_music_decode(pocadv_Music *m) {
+    if (m->mp3) {
+        int frames = POCADV_MUSIC_CHUNK_BYTES / m->source_frame_size;
+        return pocadv_mp3_read(m->mp3, (Sint16*)m->chunk, frames) * m->source_frame_size;
+    }
+
+    Sint64 want = m->data_size - m->data_read;
+    if (want > POCADV_MUSIC_CHUNK_BYTES) want = POCADV_MUSIC_CHUNK_BYTES - POCADV_MUSIC_CHUNK_BYTES % m->source_frame_size;
+    size_t got = want > 0 ? SDL_RWread(m->file, m->chunk, 1, (size_t)want) : 0;
+    got -= got % m->source_frame_size; // a truncated file ends early
+    m->data_read += (Sint64)got;
+    return (int)got;
+}
+
+// Moves the file to `frame`, counted at the file's own rate
+static int pocadv_music_locate(pocadv_Music *m, Uint64 frame) {
+    if (m->mp3) return pocadv_mp3_seek(m->mp3, frame);
+
+    Sint64 offset = (Sint64)frame * m->source_frame_size;
+    if (offset > m->data_size || SDL_RWseek(m->file, m->data_start + offset, RW_SEEK_SET) < 0) return -1;
+    m->data_read = offset;
+    return 0;
+}
+
+// Empties the converter and the ring, with the voice out of the mixer
+static void pocadv_music_reset(pocadv_Music *m) {
+    SDL_AudioStreamClear(m->stream);
+    SDL_AtomicSet(&m->write_pos, 0);
+    SDL_AtomicSet(&m->read_pos, 0);
+    SDL_AtomicSet(&m->finished, 0);
+    m->flushed = 0;
+}
+
+// Decodes until `target` frames are waiting in the ring or the track ends.
+// Call with m->lock held.
+static void pocadv_music_fill(pocadv_Music *m, Uint32 target) {
+    int frame_size = pocadv_device_spec.channels * (int)sizeof(Sint16);
+    if (!m->started) return;
+
+    while (!SDL_AtomicGet(&m->finished)) {
+        Uint32 write = (Uint32)SDL_AtomicGet(&m->write_pos);
+        Uint32 queued = write - (Uint32)SDL_AtomicGet(&m->read_pos);
+        if (queued >= target) return;
+
+        // Move converted frames into the ring
+        int converted = SDL_AudioStreamAvailable(m->stream) / frame_size;
+        if (converted > 0) {
+            Uint32 offset = write & (POCADV_MUSIC_RING_FRAMES - 1);
+            Uint32 n = target - queued;
+            if (n > (Uint32)converted) n = (Uint32)converted;
+            if (n > POCADV_MUSIC_RING_FRAMES - offset) n = POCADV_MUSIC_RING_FRAMES - offset;
+
+            SDL_AudioStreamGet(m->stream, m->ring + (size_t)offset * pocadv_device_spec.channels, (int)n * frame_size);
+            SDL_AtomicSet(&m->write_pos, (int)(write + n)); // publishes the frames
+            continue;
+        }
+
+        if (m->flushed) {
+            SDL_AtomicSet(&m->finished, 1);
+            return;
+        }
+
+        // Feed the converter the next chunk of the file
+        int got = pocadv_music_decode(m);
+        if (got > 0 && SDL_AudioStreamPut(m->stream, m->chunk, got) == 0) {
+            m->pass_empty = 0;
+            continue;
+        }
+
+        // At the end of the file, loop without flushing so the converter
+        // carries straight on into the next pass
+        if (m->loops_remaining != 0 && !m->pass_empty) {
+            if (m->loops_remaining > 0) m->loops_remaining--;
+            pocadv_music_locate(m, 0);
+            m->pass_empty = 1;
+        } else {
+            SDL_AudioStreamFlush(m->stream);
+            m->flushed = 1;
+        }
+    }
+}
+
+static int pocadv_music_thread(void *data) {
+    pocadv_Music *m = (pocadv_Music*)data;
+
+    while (!SDL_AtomicGet(&m->quit)) {
+        SDL_LockMutex(m->lock);
+        pocadv_music_fill(m, POCADV_MUSIC_RING_FRAMES);
+        SDL_UnlockMutex(m->lock);
+
+        // The mixer posts after every buffer it takes; the timeout is a backstop
+        SDL_SemWaitTimeout(m->wake, 100);
+    }
+    return 0;
+}
+
+static void pocadv_music_destroy(pocadv_Music *m) {
+    if (m->mp3) pocadv_mp3_close(m->mp3);
+    if (m->file) SDL_RWclose(m->file);
+    if (m->stream) SDL_FreeAudioStream(m->stream);
+    if (m->lock) SDL_DestroyMutex(m->lock);
+    if (m->wake) SDL_DestroySemaphore(m->wake);
+    free(m->chunk);
+    free(m->ring);
+    free(m);
+}
+
+pocadv_Music* pocadv_music_open(const char *file) {
+    if (!file || pocadv_audio_device == 0) return NULL;
+
+    pocadv_Music *m = (pocadv_Music*)calloc(1, sizeof(pocadv_Music));
+    if (!m) return NULL;
+    m->voice.music = m;
+    pocadv_ramp_set(&m->voice.gain, 1.0f);
+    pocadv_ramp_set(&m->voice.dry, 1.0f);
+
+    SDL_AudioSpec spec;
+    m->file = SDL_RWFromFile(file, "rb");
+    if (m->file && (m->mp3 = pocadv_mp3_open(m->file)) != NULL) {
+        SDL_zero(spec);
+        spec.freq = m->mp3->freq;
+        spec.format = AUDIO_S16SYS;
+        spec.channels = (Uint8)m->mp3->channels;
+        m->source_frame_size = m->mp3->channels * (int)sizeof(Sint16);
+    }
+    if (!m->file ||
+        (!m->mp3 && (SDL_RWseek(m->file, 0, RW_SEEK_SET) < 0 ||
+                     pocadv_wav_open(m->file, &spec, &m->data_start, &m->data_size, &m->source_frame_size, NULL) < 0)) ||
+        !(m->stream = SDL_NewAudioStream(spec.format, spec.channels, spec.freq,
+                                         pocadv_device_spec.format, pocadv_device_spec.channels,
+                                         pocadv_device_spec.freq)) ||
+        !(m->chunk = (Uint8*)malloc(POCADV_MUSIC_CHUNK_BYTES)) ||
+        !(m->ring = (Sint16*)malloc((size_t)POCADV_MUSIC_RING_FRAMES * pocadv_device_spec.channels * sizeof(Sint16))) ||
+        !(m->lock = SDL_CreateMutex()) || !(m->wake = SDL_CreateSemaphore(0)) ||
+        pocadv_voice_reserve() < 0) {
+        pocadv_music_destroy(m);
+        return NULL;
+    }
+    m->source_freq = spec.freq;
+
+    m->thread = SDL_CreateThread(pocadv_music_thread, "pocadv_music", m);
+    if (!m->thread) {
+        pocadv_voice_release(&m->voice);
+        pocadv_music_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+int pocadv_music_play(pocadv_Music *music, int loop_count) {
+    if (!music || pocadv_audio_device == 0) return -1;
+
+    SDL_LockMutex(music->lock);
+
+    // Out of the mixer while its ring is emptied
+    pocadv_audio_lock();
+    pocadv_audio_drain();
+    pocadv_voice_remove(&music->voice);
+    pocadv_audio_unlock();
+
+    pocadv_music_locate(music, 0);
+    pocadv_music_reset(music);
+    music->pass_empty = 1;
+    music->loops_remaining = loop_count == 0 ? -1 : loop_count - 1;
+    music->started = 1;
+
+    // A few buffers up front so it starts without a gap; the worker does the rest
+    pocadv_music_fill(music, 4 * pocadv_mix_bus_frames);
+    SDL_UnlockMutex(music->lock);
+
+    SDL_SemPost(music->wake);
+    pocadv_audio_push(POCADV_AUDIO_PLAY, &music->voice, 0);
+    return 0;
+}
+
+int pocadv_music_seek(pocadv_Music *music, double seconds) {
+    if (!music || !music->started || !(seconds >= 0.0)) return -1;
+
+    SDL_LockMutex(music->lock);
+    if (pocadv_music_locate(music, (Uint64)(seconds * music->source_freq + 0.5)) < 0) {
+        SDL_UnlockMutex(music->lock);
+        return -1;
+    }
+
+    pocadv_audio_lock();
+    pocadv_audio_drain();
+    int state = music->voice.playing;
+    pocadv_voice_remove(&music->voice);
+    pocadv_audio_unlock();
+
+    pocadv_music_reset(music);
+    music->pass_empty = 0;
+    if (state != 0) pocadv_music_fill(music, 4 * pocadv_mix_bus_frames);
+    SDL_UnlockMutex(music->lock);
+
+    SDL_SemPost(music->wake);
+    if (state != 0) pocadv_audio_push(POCADV_AUDIO_PLAY, &music->voice, 0);
+    if (state == 2) pocadv_audio_push(POCADV_AUDIO_PAUSE, &music->voice, 0);
+    return 0;
+}
+
+void pocadv_music_stop(pocadv_Music *music) {
+    if (music) pocadv_audio_push(POCADV_AUDIO_STOP, &music->voice, 0);
+}
+
+void pocadv_music_pause(pocadv_Music *music) {
+    if (music) pocadv_audio_push(POCADV_AUDIO_PAUSE, &music->voice, 0);
+}
+
+void pocadv_music_unpause(pocadv_Music *music) {
+    if (music) pocadv_audio_push(POCADV_AUDIO_UNPAUSE, &music->voice, 0);
+}
+
+void pocadv_music_close(pocadv_Music *music) {
+    if (!music) return;
+
+    SDL_AtomicSet(&music->quit, 1);
+    SDL_SemPost(music->wake);
+    SDL_WaitThread(music->thread, NULL);
+
+    pocadv_voice_release(&music->voice);
+    pocadv_music_destroy(music);
+}
+
+void pocadv_music_set_gain(pocadv_Music *music, float gain) {
+    pocadv_music_fade(music, gain, 0.0f, POCADV_FADE_LINEAR);
+}
+
+void pocadv_music_set_pan(pocadv_Music *music, float pan) {
+    if (music) pocadv_audio_set_pan(&music->voice, pan);
+}
+
+void pocadv_music_fade(pocadv_Music *music, float gain, float seconds, pocadv_Fade curve) {
+    if (music) pocadv_audio_fade(&music->voice, gain, seconds, curve);
+}
+
+static PocadvFxBus* pocadv_fx_get(int bus) {
+    if (pocadv_audio_device == 0 || bus < 0 || bus >= pocadv_fx_count) return NULL;
+    return &pocadv_fx[bus];
+}
+
+// Coefficients from the Audio EQ Cookbook
+void pocadv_bus_set_filter(int bus, pocadv_Filter type, float cutoff, float q) {
+    PocadvFxBus *b = pocadv_fx_get(bus);
+    if (!b) return;
+
+    float freq = (float)pocadv_device_spec.freq;
+    cutoff = cutoff < 10.0f ? 10.0f : cutoff > 0.49f * freq ? 0.49f * freq : cutoff;
+    q = q > 0.1f ? q : 0.1f;
+    float w = 2.0f * (float)M_PI * cutoff / freq, cosw = SDL_cosf(w), alpha = SDL_sinf(w) / (2.0f * q);
+    float a0 = 1.0f + alpha, edge = type == POCADV_FILTER_HIGHPASS ? (1.0f + cosw) / 2.0f : (1.0f - cosw) / 2.0f;
+    float coefs[5] = {edge / a0, (type == POCADV_FILTER_HIGHPASS ? -2.0f : 2.0f) * edge / a0, edge / a0,
+                      -2.0f * cosw / a0, (1.0f - alpha) / a0};
+
+    pocadv_audio_lock();
+    if (b->filter == POCADV_FILTER_NONE) SDL_memset(b->state, 0, sizeof(b->state));
+    b->filter = type;
+    SDL_memcpy(b->coefs, coefs, sizeof(coefs));
+    pocadv_audio_unlock();
+}
+
+void pocadv_bus_set_delay(int bus, float seconds, float feedback) {
+    PocadvFxBus *b = pocadv_fx_get(bus);
+    if (!b) return;
+
+    Uint32 frames = seconds > 0.0f ? (Uint32)(seconds * pocadv_device_spec.freq + 0.5f) : 0;
+    if (frames > b->delay_capacity) frames = b->delay_capacity;
+    feedback = feedback < 0.0f ? 0.0f : feedback > 0.95f ? 0.95f : feedback;
+
+    pocadv_audio_lock();
+    if (frames != b->delay_frames) {
+        // A new length starts from silence rather than replaying old echoes
+        SDL_memset(b->delay, 0, (size_t)b->delay_frames * pocadv_device_spec.channels * sizeof(float));
+        b->delay_frames = frames;
+        b->delay_pos = 0;
+    }
+    b->feedback = feedback;
+    pocadv_audio_unlock();
+}
+
+void pocadv_bus_set_reverb(int bus, float decay, float damping) {
+    PocadvFxBus *b = pocadv_fx_get(bus);
+    if (!b) return;
+
+    // Each line loses 60 dB over `decay`, however long it is
+    float gains[POCADV_FX_LINES] = {0};
+    for (int k = 0; k < POCADV_FX_LINES && decay > 0.0f; k++)
+        gains[k] = SDL_powf(0.001f, (float)b->line_frames[k] / (decay * pocadv_device_spec.freq));
+
+    pocadv_audio_lock();
+    if (b->line_gain[0] == 0.0f) {
+        for (int k = 0; k < POCADV_FX_LINES; k++) {
+            SDL_memset(b->lines[k], 0, b->line_frames[k] * sizeof(float));
+            b->line_low[k] = 0.0f;
+        }
+    }
+    SDL_memcpy(b->line_gain, gains, sizeof(gains));
+    b->damping = damping < 0.0f ? 0.0f : damping > 0.95f ? 0.95f : damping;
+    pocadv_audio_unlock();
+}
+
+void pocadv_bus_set_return(int bus, float gain) {
+    PocadvFxBus *b = pocadv_fx_get(bus);
+    if (!b) return;
+    pocadv_audio_lock();
+    b->ret_target = gain > 0.0f ? gain : 0.0f;
+    pocadv_audio_unlock();
+}
+
+void pocadv_audio_set_send(pocadv_Audio *audio, int bus, float level) {
+    if (audio) pocadv_audio_push_send(audio, NULL, bus, level);
+}
+
+void pocadv_set_sound_send(int sound_id, int bus, float level) {
+    PocadvSound *s = pocadv_sound_get(sound_id);
+    if (s) pocadv_audio_push_send(NULL, s, bus, level);
+}
+
+void pocadv_music_set_send(pocadv_Music *music, int bus, float level) {
+    if (music) pocadv_audio_set_send(&music->voice, bus, level);
 }
 
 #ifdef __cplusplus